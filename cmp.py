@@ -178,6 +178,49 @@ def _process_tile_image_content(filepath):
 
     return tiles_data
 
+def _process_indexed_tile_image_content(filepath):
+    """Opens PNG image, returns a 256-entry BGRA palette followed by one palette index per pixel, in tile order."""
+    img = Image.open(filepath).convert("RGBA")
+
+    palette = []
+    palette_lookup = {}
+    indices = bytearray()
+
+    for i in range(128*128):
+        tileNum = i // 64
+        pxNum = i % 64
+        tileRow = tileNum // 16
+        tileCol = tileNum % 16
+        tileY = pxNum // 8
+        tileX = pxNum % 8
+        pxX = tileCol*8+tileX
+        pxY = tileRow*8+tileY
+        color = img.getpixel((pxX,pxY))
+        if color not in palette_lookup:
+            if len(palette) == 256:
+                raise ValueError("indexed tile pages can use at most 256 colors")
+            palette_lookup[color] = len(palette)
+            palette.append(color)
+        indices.append(palette_lookup[color])
+
+    tiles_data = bytearray()
+    for r, g, b, a in palette:
+        tiles_data.extend([b, g, r, a])
+    tiles_data.extend(bytes(4 * (256 - len(palette))))
+    tiles_data.extend(indices)
+
+    return tiles_data
+
+def _process_tile_flags_content(filepath):
+    """Parses a text file of 256 attribute values, 16 rows of 16 like the tiles of a page, returns one byte per tile.
+    Files are named by page number like tile pages (03.txt for page 3); values may be decimal or 0x hex."""
+    with open(filepath, 'r', encoding='utf-8') as f:
+        values = [int(value, 0) for value in f.read().replace(',', ' ').split()]
+    if len(values) != 256:
+        raise ValueError(f"tile flags need 256 values, found {len(values)}")
+    if any(value < 0 or value > 255 for value in values):
+        raise ValueError("tile flags must be between 0 and 255")
+    return bytearray(values)
 
 def _process_tilemap_content(filepath):
     """Parses TMX file, extracts and processes tile IDs, returns as bytearray."""
@@ -244,6 +287,26 @@ if __name__ == "__main__":
             process_logic=_process_tile_image_content,
             db_mtime = mtime,
         ))
+        all_processed_entries.update(_process_generic_files(
+            database_connection,
+            args.input_directory,
+            subfolder="itiles",
+            file_filter_logic=filter_by_extension(".png"),
+            cache_extension="itiles",
+            db_type="itiles",
+            process_logic=_process_indexed_tile_image_content,
+            db_mtime = mtime,
+        ))
+        all_processed_entries.update(_process_generic_files(
+            database_connection,
+            args.input_directory,
+            subfolder="tileflags",
+            file_filter_logic=filter_by_extension(".txt"),
+            cache_extension="tileflags",
+            db_type="tileflags",
+            process_logic=_process_tile_flags_content,
+            db_mtime = mtime,
+        ))
         all_processed_entries.update(_process_generic_files(
             database_connection,
             args.input_directory,
@@ -0,0 +1,294 @@
+#include "posi.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// In deferred mode the posiAPIDraw* functions append a command here instead of drawing.
+// At the end of the tick the list is sorted by layer (call order within a layer) and replayed.
+struct DrawCommand {
+	uint64_t sortKey;
+	DrawCommandType type;
+	DrawState state;
+	uint32_t color;
+	int32_t args[drawCommandMaxArgs];
+};
+
+std::vector<DrawCommand> drawCommands;
+std::vector<char> drawCommandText;
+bool drawDeferred = false;
+int drawLayer = 0;
+// Set when a command reads pixels other commands write, which rules out banded replay
+bool drawCommandsReadBack = false;
+
+// Replay can be split into horizontal bands, one per render thread. Every band replays the
+// whole sorted list clipped to its own rows, so bands never touch the same pixel and the
+// result is identical to a serial replay.
+static constexpr int maxRenderThreads = 16;
+static std::vector<std::thread> bandThreads;
+static std::mutex bandMutex;
+static std::condition_variable bandStart;
+static std::condition_variable bandDone;
+static uint64_t bandGeneration = 0;
+static int bandCount = 1;
+static int bandsPending = 0;
+static bool bandShutdown = false;
+
+static uint64_t makeSortKey(int layer, size_t sequence) {
+	// Flip the sign bit so negative layers sort below positive ones
+	return ((uint64_t)((uint32_t)layer ^ 0x80000000u) << 32) | (uint32_t)sequence;
+}
+
+// Only drawing to the screen is deferred; surfaces are drawn into immediately
+bool drawListRecording() {
+	return drawDeferred && gpuGetDrawTarget() < 0;
+}
+
+static void appendCommand(DrawCommandType type, int layer, const DrawState& state, uint32_t color, std::initializer_list<int> args) {
+	DrawCommand& command = drawCommands.emplace_back();
+	command.sortKey = makeSortKey(layer, drawCommands.size() - 1);
+	command.type = type;
+	command.state = state;
+	command.color = color;
+	std::fill(std::begin(command.args), std::end(command.args), 0);
+	std::copy_n(args.begin(), std::min<size_t>(args.size(), drawCommandMaxArgs), command.args);
+}
+
+void drawListRecord(DrawCommandType type, uint32_t color, std::initializer_list<int> args) {
+	if (type == DRAW_COPY_RECT || type == DRAW_SCROLL_RECT) {
+		drawCommandsReadBack = true;
+	}
+	appendCommand(type, drawLayer, gpuGetDrawState(), color, args);
+}
+
+// Queues a sprite on the given layer regardless of the deferred setting. It is drawn in screen
+// coordinates with the default state: opaque, no camera and no clipping beyond the screen.
+void drawListRecordSprite(const SpriteDesc& sprite, int layer) {
+	appendCommand(DRAW_SPRITE, layer, DrawState{}, 0, {sprite.id, sprite.w, sprite.h, sprite.x, sprite.y,
+		(sprite.flags & spriteFlipHorz) != 0, (sprite.flags & spriteFlipVert) != 0});
+}
+
+void drawListRecordText(DrawCommandType type, std::string_view text, uint32_t color, std::initializer_list<int> args) {
+	// Keep payloads 4-byte aligned so pixel data can be read back as uint32_t
+	drawCommandText.resize((drawCommandText.size() + 3) & ~(size_t)3);
+	const int offset = (int)drawCommandText.size();
+	drawCommandText.insert(drawCommandText.end(), text.begin(), text.end());
+	drawListRecord(type, color, args);
+	// The last two arguments locate the text in the shared buffer
+	drawCommands.back().args[drawCommandMaxArgs - 2] = offset;
+	drawCommands.back().args[drawCommandMaxArgs - 1] = (int)text.size();
+}
+
+static void executeDrawCommand(const DrawCommand& c) {
+	const int32_t* a = c.args;
+	gpuSetDrawState(c.state);
+	switch (c.type) {
+		case DRAW_CLS:
+			posiAPICls(c.color);
+			break;
+		case DRAW_PIXEL:
+			posiAPIPutPixel(a[0], a[1], c.color);
+			break;
+		case DRAW_SPRITE:
+			posiAPIDrawSprite(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+			break;
+		case DRAW_TILEMAP:
+			posiAPIDrawTilemap(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+			break;
+		case DRAW_LINE:
+			posiAPIDrawLine(a[0], a[1], a[2], a[3], c.color);
+			break;
+		case DRAW_RECT:
+			posiAPIDrawRect(a[0], a[1], a[2], a[3], c.color);
+			break;
+		case DRAW_FILLED_RECT:
+			posiAPIDrawFilledRect(a[0], a[1], a[2], a[3], c.color);
+			break;
+		case DRAW_CIRCLE:
+			posiAPIDrawCircle(a[0], a[1], a[2], c.color);
+			break;
+		case DRAW_FILLED_CIRCLE:
+			posiAPIDrawFilledCircle(a[0], a[1], a[2], c.color);
+			break;
+		case DRAW_ELLIPSE:
+			posiAPIDrawEllipse(a[0], a[1], a[2], a[3], c.color);
+			break;
+		case DRAW_FILLED_ELLIPSE:
+			posiAPIDrawFilledEllipse(a[0], a[1], a[2], a[3], c.color);
+			break;
+		case DRAW_ARC:
+			posiAPIDrawArc(a[0], a[1], a[2], a[3], a[4], a[5], c.color);
+			break;
+		case DRAW_FILLED_ARC:
+			posiAPIDrawFilledArc(a[0], a[1], a[2], a[3], a[4], a[5], c.color);
+			break;
+		case DRAW_TRIANGLE:
+			posiAPIDrawTriangle(a[0], a[1], a[2], a[3], a[4], a[5], c.color);
+			break;
+		case DRAW_FILLED_TRIANGLE:
+			posiAPIDrawFilledTriangle(a[0], a[1], a[2], a[3], a[4], a[5], c.color);
+			break;
+		case DRAW_FILLED_POLYGON:
+			posiAPIDrawFilledPolygon((const int32_t*)(drawCommandText.data() + a[drawCommandMaxArgs - 2]), a[0], a[1], c.color);
+			break;
+		case DRAW_TEXT: {
+			std::string_view text(drawCommandText.data() + a[drawCommandMaxArgs - 2], a[drawCommandMaxArgs - 1]);
+			posiAPIDrawText(text, a[0], a[1], a[2], c.color, a[3]);
+			break;
+		}
+		case DRAW_TEXT_WRAPPED: {
+			std::string_view text(drawCommandText.data() + a[drawCommandMaxArgs - 2], a[drawCommandMaxArgs - 1]);
+			posiAPIDrawTextWrapped(text, a[0], a[1], a[2], a[3], c.color, a[4]);
+			break;
+		}
+		case DRAW_SPRITE_AFFINE:
+			posiAPIDrawSpriteAffine(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+			break;
+		case DRAW_MODE7:
+			posiAPIDrawMode7(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+			break;
+		case DRAW_TILEMAP_SCANLINES:
+			posiAPIDrawTilemapScanlines(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+			break;
+		case DRAW_PIXELS:
+			posiAPIWritePixels(a[0], a[1], a[2], a[3], (const uint32_t*)(drawCommandText.data() + a[drawCommandMaxArgs - 2]));
+			break;
+		case DRAW_COPY_RECT:
+			posiAPICopyRect(a[0], a[1], a[2], a[3], a[4], a[5]);
+			break;
+		case DRAW_SCROLL_RECT:
+			posiAPIScrollRect(a[0], a[1], a[2], a[3], a[4], a[5]);
+			break;
+		case DRAW_SURFACE:
+			posiAPIDrawSurface(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+			break;
+		default:
+			break;
+	}
+}
+
+static void replayBand(int band, int bands) {
+	gpuSetClipRows(screenHeight * band / bands, screenHeight * (band + 1) / bands);
+	for (const auto& command : drawCommands) {
+		executeDrawCommand(command);
+	}
+	gpuSetClipRows(0, screenHeight);
+}
+
+static void bandWorker(int band, uint64_t seenGeneration) {
+	for (;;) {
+		int bands;
+		{
+			std::unique_lock lock(bandMutex);
+			bandStart.wait(lock, [&] { return bandShutdown || bandGeneration != seenGeneration; });
+			if (bandShutdown) {
+				return;
+			}
+			seenGeneration = bandGeneration;
+			bands = bandCount;
+		}
+		replayBand(band, bands);
+		{
+			std::lock_guard lock(bandMutex);
+			if (--bandsPending == 0) {
+				bandDone.notify_one();
+			}
+		}
+	}
+}
+
+static void stopBandWorkers() {
+	{
+		std::lock_guard lock(bandMutex);
+		bandShutdown = true;
+	}
+	bandStart.notify_all();
+	for (auto& thread : bandThreads) {
+		thread.join();
+	}
+	bandThreads.clear();
+	bandShutdown = false;
+}
+
+// Joins the workers before the globals they use are destroyed
+static struct BandWorkerGuard {
+	~BandWorkerGuard() { stopBandWorkers(); }
+} bandWorkerGuard;
+
+static void replayBanded() {
+	{
+		std::lock_guard lock(bandMutex);
+		bandCount = (int)bandThreads.size() + 1;
+		bandsPending = (int)bandThreads.size();
+		++bandGeneration;
+	}
+	bandStart.notify_all();
+	// The calling thread takes the first band
+	replayBand(0, bandCount);
+	std::unique_lock lock(bandMutex);
+	bandDone.wait(lock, [] { return bandsPending == 0; });
+}
+
+void drawListFlush() {
+	if (drawCommands.empty()) {
+		return;
+	}
+	std::sort(drawCommands.begin(), drawCommands.end(), [](const DrawCommand& a, const DrawCommand& b) {
+		return a.sortKey < b.sortKey;
+	});
+
+	const bool wasDeferred = drawDeferred;
+	const DrawState state = gpuGetDrawState();
+	const int target = gpuGetDrawTarget();
+	drawDeferred = false;
+	posiAPISetDrawTarget(-1);
+	if (bandThreads.empty() || drawCommandsReadBack) {
+		for (const auto& command : drawCommands) {
+			executeDrawCommand(command);
+		}
+	} else {
+		replayBanded();
+	}
+	drawDeferred = wasDeferred;
+	gpuSetDrawState(state);
+	posiAPISetDrawTarget(target);
+
+	drawCommands.clear();
+	drawCommandText.clear();
+	drawCommandsReadBack = false;
+}
+
+void drawListClear() {
+	drawCommands.clear();
+	drawCommandText.clear();
+	drawCommandsReadBack = false;
+	drawDeferred = false;
+	drawLayer = 0;
+}
+
+void posiAPISetDrawDeferred(bool enabled) {
+	if (drawDeferred && !enabled) {
+		drawListFlush();
+	}
+	drawDeferred = enabled;
+}
+
+void posiAPISetDrawLayer(int layer) {
+	drawLayer = layer;
+}
+
+// 1 replays on the calling thread only; more splits the screen into that many bands.
+// Only deferred drawing is banded, immediate calls always draw on the calling thread.
+void posiAPISetRenderThreads(int count) {
+	count = std::clamp(count, 1, maxRenderThreads);
+	if (count == (int)bandThreads.size() + 1) {
+		return;
+	}
+	stopBandWorkers();
+	for (int band = 1; band < count; ++band) {
+		bandThreads.emplace_back(bandWorker, band, bandGeneration);
+	}
+}
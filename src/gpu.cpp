@@ -5,68 +5,704 @@
 #include <array>
 #include <utility>
 #include <algorithm>
+#include <charconv>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static constexpr uint32_t COLOR_ALPHA_MASK = 0xFF000000;
 
 std::array<uint32_t, screenWidth * screenHeight> frameBuffer;
-std::array<uint32_t, numTilesPixels> tiles;
+
+// Off-screen images that can be drawn into and blitted like sprites. They share a fixed pixel budget.
+struct Surface {
+	std::vector<uint32_t> pixels;
+	int width = 0;
+	int height = 0;
+};
+static constexpr int surfacePixelBudget = screenWidth * screenHeight * 4;
+std::array<Surface, maxSurfaces> surfaces;
+static int surfacePixelsUsed = 0;
+
+// Where primitives draw: the screen, or the surface with the given id. Rows are width pixels apart.
+struct DrawTarget {
+	int id;
+	uint32_t* pixels;
+	int width, height;
+};
+DrawTarget drawTarget = {-1, frameBuffer.data(), screenWidth, screenHeight};
+
+static inline uint32_t* targetRow(int y) {
+	return drawTarget.pixels + y * drawTarget.width;
+}
+
+// Half-open rectangle every primitive is clipped to: the draw target, narrowed to the user's clip
+// rectangle and this thread's band of rows. It is per thread so that banded rendering can give
+// each worker its own slice; the user state is per thread because replay restores it per command.
+struct ClipRect {
+	int x0, y0, x1, y1;
+};
+thread_local ClipRect clipRect = {0, 0, screenWidth, screenHeight};
+thread_local ClipRect userClip = {0, 0, screenWidth, screenHeight};
+thread_local int bandY0 = 0;
+thread_local int bandY1 = screenHeight;
+
+// Subtracted from the position of every primitive except cls and the mode-7 plane
+thread_local int cameraX = 0;
+thread_local int cameraY = 0;
+
+static void updateClipRect() {
+	const int x0 = std::max(userClip.x0, 0);
+	const int y0 = std::max({userClip.y0, bandY0, 0});
+	const int x1 = std::min(userClip.x1, drawTarget.width);
+	const int y1 = std::min({userClip.y1, bandY1, drawTarget.height});
+	clipRect = {x0, y0, std::max(x1, x0), std::max(y1, y0)};
+}
+
+// True when the inclusive box x0..x1, y0..y1 misses the clip rectangle entirely
+static inline bool outsideClip(int x0, int y0, int x1, int y1) {
+	return x1 < clipRect.x0 || x0 >= clipRect.x1 || y1 < clipRect.y0 || y0 >= clipRect.y1;
+}
+
+// Columns [x0, x1) of each row written since the presenter last collected them, so only
+// changed pixels need uploading. A row is only ever written by the band that owns it.
+struct DirtyRow {
+	int16_t x0 = screenWidth;
+	int16_t x1 = 0;
+};
+std::array<DirtyRow, screenHeight> dirtyRows;
+static constexpr int maxDirtyRects = 16;
+
+static inline void markDirty(int x0, int x1, int y0, int y1) {
+	if (drawTarget.id >= 0) {
+		return;
+	}
+	// Clamped before narrowing to the int16_t row bounds
+	x0 = std::clamp(x0, 0, screenWidth);
+	x1 = std::clamp(x1, 0, screenWidth);
+	y0 = std::clamp(y0, 0, screenHeight);
+	y1 = std::clamp(y1, 0, screenHeight);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	for (int y = y0; y < y1; ++y) {
+		DirtyRow& row = dirtyRows[y];
+		row.x0 = std::min<int16_t>(row.x0, x0);
+		row.x1 = std::max<int16_t>(row.x1, x1);
+	}
+}
+
+static void markAllDirty() {
+	dirtyRows.fill(DirtyRow{0, screenWidth});
+}
+
+// Groups runs of consecutive dirty rows into rectangles and marks everything clean.
+// Falls back to one bounding rectangle when the changes are too scattered to be worth splitting.
+void gpuTakeDirtyRects(std::vector<DirtyRect>& rects) {
+	rects.clear();
+	for (int y = 0; y < screenHeight; ++y) {
+		const DirtyRow row = dirtyRows[y];
+		if (row.x0 >= row.x1) {
+			continue;
+		}
+		if (!rects.empty() && rects.back().y + rects.back().h == y) {
+			DirtyRect& rect = rects.back();
+			const int x1 = std::max<int>(rect.x + rect.w, row.x1);
+			rect.x = std::min<int>(rect.x, row.x0);
+			rect.w = x1 - rect.x;
+			rect.h++;
+		} else {
+			rects.push_back({row.x0, y, row.x1 - row.x0, 1});
+		}
+	}
+	if ((int)rects.size() > maxDirtyRects) {
+		DirtyRect bounds = rects.front();
+		int x1 = bounds.x + bounds.w;
+		for (const auto& rect : rects) {
+			bounds.x = std::min(bounds.x, rect.x);
+			x1 = std::max(x1, rect.x + rect.w);
+		}
+		bounds.w = x1 - bounds.x;
+		bounds.h = rects.back().y + rects.back().h - bounds.y;
+		rects.assign(1, bounds);
+	}
+	dirtyRows.fill(DirtyRow{});
+}
+
+enum TilePageFormat {TILE_PAGE_EMPTY, TILE_PAGE_BGRA, TILE_PAGE_INDEXED};
+enum TileOpacity : uint8_t {TILE_TRANSPARENT, TILE_OPAQUE, TILE_MIXED};
+
+// Bounding box of the non-zero pixels of a tile, as used by proportional text. horzMax is -1 for blank tiles.
+struct GlyphMetrics {
+	int8_t horzMin = 0;
+	int8_t horzMax = -1;
+	int8_t vertMax = -1;
+};
+
+// A page is stored either as BGRA pixels or as 8-bit indices into its own palette.
+// Pages missing from the cartridge take no memory and read as transparent.
+// Every tile is also classified by its alpha so blitters can skip empty tiles and copy opaque ones,
+// measured as a glyph so text doesn't have to rescan it, and reduced to a collision mask.
+struct TilePage {
+	TilePageFormat format = TILE_PAGE_EMPTY;
+	std::vector<uint32_t> pixels;
+	std::vector<uint8_t> indices;
+	std::array<uint32_t, tilePaletteSize> palette{};
+	std::array<TileOpacity, tilesPerPage> opacity{};
+	std::array<GlyphMetrics, tilesPerPage> glyphs{};
+	// Bit (row * 8 + col) is set where the pixel's alpha is non-zero
+	std::array<uint64_t, tilesPerPage> masks{};
+};
+
+std::array<TilePage, numTilePages> tilePages;
+static const std::array<uint32_t, tileSide> emptyTileRow{};
 std::array<uint16_t, tilemapTotalTiles> tilemaps[numTilemaps];
 
+// Game-defined attributes of every tile, such as tileFlagSolid, used by the tilemap queries
+std::array<uint8_t, numTiles> tileFlags;
+
+static constexpr int TILE_FLIP_H_FLAG = 0x8000;
+static constexpr int TILE_FLIP_V_FLAG = 0x4000;
+static constexpr int TILE_ID_MASK     = 0x3FFF;
+
+// Pre-rendered pixels of a whole tilemap, for backgrounds that are redrawn every tick.
+// A cell is rendered the first time it is drawn and again only after its entry or its
+// tile's palette changes, so drawing the layer is mostly a copy out of the cache.
+// Each cache holds the full 2048x2048 map, 16MB, so only maxCachedTilemaps can exist at once.
+static constexpr int tilemapCacheWidth = tilemapTotalWidthTiles * tileSide;
+struct TilemapCache {
+	std::vector<uint32_t> pixels = std::vector<uint32_t>(tilemapCacheWidth * tilemapTotalHeightTiles * tileSide);
+	std::vector<TileOpacity> opacity = std::vector<TileOpacity>(tilemapTotalTiles);
+	std::vector<uint8_t> valid = std::vector<uint8_t>(tilemapTotalTiles);
+};
+std::array<std::unique_ptr<TilemapCache>, numTilemaps> tilemapCaches;
+// Banded replay can fill cells from several threads at once
+static std::mutex tilemapCacheMutex;
+
+// Per-line scroll offsets for raster effects, indexed by the draw target row being drawn
+struct ScrollLine {
+	int dx = 0;
+	int dy = 0;
+};
+std::array<std::array<ScrollLine, screenHeight>, numScrollTables> scrollTables;
+
+// Marks every cached cell that shows a tile of the given page for re-rendering.
+static void invalidateTilemapCaches(int pageNum) {
+	for (int i = 0; i < numTilemaps; ++i) {
+		TilemapCache* cache = tilemapCaches[i].get();
+		if (!cache) {
+			continue;
+		}
+		for (int cell = 0; cell < tilemapTotalTiles; ++cell) {
+			if ((tilemaps[i][cell] & TILE_ID_MASK) / tilesPerPage == pageNum) {
+				cache->valid[cell] = 0;
+			}
+		}
+	}
+}
+
+thread_local BlendMode blendMode = BLEND_OPAQUE;
+
+// x * a / 255, rounded
+static inline uint32_t mulDiv255(uint32_t x, uint32_t a) {
+	uint32_t t = x * a + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+// Scalar reference for the blend kernels. The source alpha weights every mode, and the destination alpha is kept.
+template<BlendMode mode>
+static inline uint32_t blendPixel(uint32_t dst, uint32_t src) {
+	const uint32_t a = src >> 24;
+	uint32_t result = dst & COLOR_ALPHA_MASK;
+	for (int shift = 0; shift < 24; shift += 8) {
+		const int s = (src >> shift) & 0xFF;
+		const int d = (dst >> shift) & 0xFF;
+		int c;
+		if constexpr (mode == BLEND_ALPHA) {
+			c = mulDiv255(s, a) + mulDiv255(d, 255 - a);
+		} else if constexpr (mode == BLEND_ADD) {
+			c = d + mulDiv255(s, a);
+		} else if constexpr (mode == BLEND_MULTIPLY) {
+			c = mulDiv255(mulDiv255(d, s), a) + mulDiv255(d, 255 - a);
+		} else if constexpr (mode == BLEND_SUBTRACT) {
+			c = d - (int)mulDiv255(s, a);
+		} else {
+			c = s;
+		}
+		result |= (uint32_t)std::clamp(c, 0, 255) << shift;
+	}
+	return result;
+}
+
+#if defined(__SSE2__)
+// Same as mulDiv255 on eight 16-bit lanes
+static inline __m128i mulDiv255x8(__m128i x, __m128i a) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Blends two pixels held as 16-bit channels
+template<BlendMode mode>
+static inline __m128i blendChannels(__m128i d, __m128i s) {
+	const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	const __m128i inverseA = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	if constexpr (mode == BLEND_ALPHA) {
+		return _mm_add_epi16(mulDiv255x8(s, a), mulDiv255x8(d, inverseA));
+	} else if constexpr (mode == BLEND_ADD) {
+		return _mm_add_epi16(d, mulDiv255x8(s, a));
+	} else if constexpr (mode == BLEND_MULTIPLY) {
+		return _mm_add_epi16(mulDiv255x8(mulDiv255x8(d, s), a), mulDiv255x8(d, inverseA));
+	} else {
+		return _mm_sub_epi16(d, mulDiv255x8(s, a));
+	}
+}
+#endif
+
+template<BlendMode mode>
+static void blendRow(uint32_t* dst, const uint32_t* src, int count) {
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(COLOR_ALPHA_MASK);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		const __m128i lo = blendChannels<mode>(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+		const __m128i hi = blendChannels<mode>(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+		const __m128i blended = _mm_packus_epi16(lo, hi);
+		const __m128i result = _mm_or_si128(_mm_andnot_si128(alphaMask, blended), _mm_and_si128(alphaMask, d));
+		_mm_storeu_si128((__m128i*)(dst + i), result);
+	}
+#endif
+	for (; i < count; ++i) {
+		dst[i] = blendPixel<mode>(dst[i], src[i]);
+	}
+}
+
+// Combines count source pixels into dst with the current blend mode. Opaque mode keeps the
+// binary alpha test used everywhere else: pixels with zero alpha are skipped, the rest overwrite.
+static void blendPixels(uint32_t* dst, const uint32_t* src, int count) {
+	switch (blendMode) {
+		case BLEND_ALPHA:
+			blendRow<BLEND_ALPHA>(dst, src, count);
+			break;
+		case BLEND_ADD:
+			blendRow<BLEND_ADD>(dst, src, count);
+			break;
+		case BLEND_MULTIPLY:
+			blendRow<BLEND_MULTIPLY>(dst, src, count);
+			break;
+		case BLEND_SUBTRACT:
+			blendRow<BLEND_SUBTRACT>(dst, src, count);
+			break;
+		default: {
+			int i = 0;
+#if defined(__SSE2__)
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i alphaMask = _mm_set1_epi32(COLOR_ALPHA_MASK);
+			for (; i + 4 <= count; i += 4) {
+				const __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+				const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+				const __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero);
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s)));
+			}
+#endif
+			for (; i < count; ++i) {
+				if (src[i] & COLOR_ALPHA_MASK) {
+					dst[i] = src[i];
+				}
+			}
+			break;
+		}
+	}
+}
+
+// Draws one already clipped pixel with the current blend mode.
+static inline void plotPixel(uint32_t* dst, uint32_t color) {
+	if (blendMode == BLEND_OPAQUE) {
+		*dst = color;
+	} else {
+		blendPixels(dst, &color, 1);
+	}
+}
+
+void posiAPISetBlendMode(int mode) {
+	if (mode < 0 || mode >= BLEND_MODE_COUNT) {
+		return;
+	}
+	blendMode = (BlendMode)mode;
+}
+
+void gpuSetClipRows(int y0, int y1) {
+	bandY0 = y0;
+	bandY1 = y1;
+	updateClipRect();
+}
+
+void posiAPISetCamera(int x, int y) {
+	cameraX = x;
+	cameraY = y;
+}
+
+// Clips all drawing to the w x h rectangle at (x, y) of the draw target
+void posiAPISetClipRect(int x, int y, int w, int h) {
+	userClip = {x, y, x + std::max(w, 0), y + std::max(h, 0)};
+	updateClipRect();
+}
+
+void posiAPIResetClipRect() {
+	posiAPISetClipRect(0, 0, screenWidth, screenHeight);
+}
+
+DrawState gpuGetDrawState() {
+	return {blendMode, cameraX, cameraY, userClip.x0, userClip.y0, userClip.x1, userClip.y1};
+}
+
+void gpuSetDrawState(const DrawState& state) {
+	blendMode = state.blend;
+	cameraX = state.cameraX;
+	cameraY = state.cameraY;
+	userClip = {state.clipX0, state.clipY0, state.clipX1, state.clipY1};
+	updateClipRect();
+}
+
 void posiPutPixel(int x, int y, uint32_t color) {
-	static constexpr uint32_t COLOR_ALPHA_MASK = 0xFF000000;
-	if (x < 0 || x >= screenWidth || y < 0 || y >= screenHeight || (color & COLOR_ALPHA_MASK) == 0) {
+	const ClipRect& clip = clipRect;
+	if (x < clip.x0 || x >= clip.x1 || y < clip.y0 || y >= clip.y1 || (color & COLOR_ALPHA_MASK) == 0) {
 		return;
 	}
 	
-	frameBuffer[y * screenWidth + x] = color;
+	plotPixel(targetRow(y) + x, color);
+	markDirty(x, x + 1, y, y + 1);
+}
+
+
+// Writes count copies of color, four pixels per store where possible.
+static inline void fillPixels(uint32_t* dst, int count, uint32_t color) {
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i wide = _mm_set1_epi32(color);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i*)(dst + i), wide);
+	}
+#endif
+	for (; i < count; ++i) {
+		dst[i] = color;
+	}
+}
+
+// Fills the horizontal run x1..x2 (inclusive, either order) of row y, clipped to the clip rectangle.
+// Like posiPutPixel, colors with zero alpha draw nothing.
+static void fillSpan(int x1, int x2, int y, uint32_t color) {
+	const ClipRect& clip = clipRect;
+	if (y < clip.y0 || y >= clip.y1 || (color & COLOR_ALPHA_MASK) == 0) {
+		return;
+	}
+	if (x1 > x2) {
+		std::swap(x1, x2);
+	}
+	x1 = std::max(x1, clip.x0);
+	x2 = std::min(x2, clip.x1 - 1);
+	if (x1 > x2) {
+		return;
+	}
+	uint32_t* dst = targetRow(y) + x1;
+	const int count = x2 - x1 + 1;
+	markDirty(x1, x2 + 1, y, y + 1);
+	if (blendMode == BLEND_OPAQUE) {
+		fillPixels(dst, count, color);
+		return;
+	}
+	uint32_t run[tileSide];
+	fillPixels(run, tileSide, color);
+	for (int i = 0; i < count; i += tileSide) {
+		blendPixels(dst + i, run, std::min(tileSide, count - i));
+	}
 }
 
+// Vertical counterpart of fillSpan: fills y1..y2 (inclusive, either order) of column x.
+static void fillColumn(int x, int y1, int y2, uint32_t color) {
+	const ClipRect& clip = clipRect;
+	if (x < clip.x0 || x >= clip.x1 || (color & COLOR_ALPHA_MASK) == 0) {
+		return;
+	}
+	if (y1 > y2) {
+		std::swap(y1, y2);
+	}
+	y1 = std::max(y1, clip.y0);
+	y2 = std::min(y2, clip.y1 - 1);
+	if (y1 > y2) {
+		return;
+	}
+	markDirty(x, x + 1, y1, y2 + 1);
+	for (int y = y1; y <= y2; ++y) {
+		plotPixel(targetRow(y) + x, color);
+	}
+}
 
 void posiAPICls(uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_CLS, color, {});
+		return;
+	}
 	color = 0xFF000000 | color;
-	for(int j = 0; j < screenHeight; j++) {
-		for(int i = 0; i < screenWidth; i++) {
-			posiPutPixel(i, j, color);
-		}
+	const ClipRect& clip = clipRect;
+	for (int y = clip.y0; y < clip.y1; ++y) {
+		fillPixels(targetRow(y) + clip.x0, clip.x1 - clip.x0, color);
 	}
+	markDirty(clip.x0, clip.x1, clip.y0, clip.y1);
 }
 
 uint32_t posiAPIGetPixel(int x, int y) {
-	if(x < 0 || x >= screenWidth || y < 0 || y >= screenHeight) {
+	if(x < 0 || x >= drawTarget.width || y < 0 || y >= drawTarget.height) {
 		return 0xFF000000;
 	}
-	return frameBuffer[y*screenWidth+x];
+	return targetRow(y)[x];
 }
 
 void posiAPIPutPixel(int x, int y, uint32_t color) {
-	posiPutPixel(x, y, color);
+	if (drawListRecording()) {
+		drawListRecord(DRAW_PIXEL, color, {x, y});
+		return;
+	}
+	posiPutPixel(x - cameraX, y - cameraY, color);
+}
+
+// The region functions below work on raw pixels in draw target coordinates; the camera doesn't apply.
+
+// Reads a w x h rectangle of the draw target into out, row by row. Pixels outside the target read
+// as opaque black, like posiAPIGetPixel. In deferred mode this sees the frame before replay.
+void posiAPIReadPixels(int x, int y, int w, int h, uint32_t* out) {
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+	for (int row = 0; row < h; ++row, out += w) {
+		const int64_t ty = (int64_t)y + row;
+		if (ty < 0 || ty >= drawTarget.height) {
+			std::fill(out, out + w, 0xFF000000);
+			continue;
+		}
+		// [x0, x1) is the part of the row inside the target, empty when the row misses it
+		const int64_t x0 = std::clamp<int64_t>(0, x, (int64_t)x + w);
+		const int64_t x1 = std::clamp<int64_t>(drawTarget.width, x0, (int64_t)x + w);
+		std::fill(out, out + (x0 - x), 0xFF000000);
+		memcpy(out + (x0 - x), targetRow((int)ty) + x0, (x1 - x0) * 4);
+		std::fill(out + (x1 - x), out + w, 0xFF000000);
+	}
+}
+
+// Overwrites a w x h rectangle with the given pixels, alpha included, clipped to the clip rectangle.
+void posiAPIWritePixels(int x, int y, int w, int h, const uint32_t* pixels) {
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+	if (drawListRecording()) {
+		drawListRecordText(DRAW_PIXELS, std::string_view((const char*)pixels, (size_t)w * h * 4), 0, {x, y, w, h});
+		return;
+	}
+	const ClipRect& clip = clipRect;
+	const int x0 = std::max(x, clip.x0);
+	const int y0 = std::max(y, clip.y0);
+	const int x1 = (int)std::min<int64_t>((int64_t)x + w, clip.x1);
+	const int y1 = (int)std::min<int64_t>((int64_t)y + h, clip.y1);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	markDirty(x0, x1, y0, y1);
+	for (int row = y0; row < y1; ++row) {
+		memcpy(targetRow(row) + x0, pixels + (size_t)(row - y) * w + (x0 - x), (x1 - x0) * 4);
+	}
+}
+
+// Copies a w x h rectangle from (sx, sy) to (dx, dy). Overlapping areas are handled, so this can
+// scroll part of the screen. The source is limited to the target, the destination to the clip rectangle.
+void posiAPICopyRect(int sx, int sy, int w, int h, int dx, int dy) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_COPY_RECT, 0, {sx, sy, w, h, dx, dy});
+		return;
+	}
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+	// Clipped in 64 bits so coordinates near INT_MAX can't wrap around into the target
+	auto clipAxis = [](int64_t& s, int64_t& d, int64_t& size, int64_t lo, int64_t hi) {
+		const int64_t skip = std::max<int64_t>(lo - d, 0);
+		s += skip;
+		d += skip;
+		size -= skip;
+		size = std::min(size, hi - d);
+	};
+	int64_t srcX = sx, srcY = sy, dstX = dx, dstY = dy, width = w, height = h;
+	clipAxis(dstX, srcX, width, 0, drawTarget.width);
+	clipAxis(dstY, srcY, height, 0, drawTarget.height);
+	clipAxis(srcX, dstX, width, clipRect.x0, clipRect.x1);
+	clipAxis(srcY, dstY, height, clipRect.y0, clipRect.y1);
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	sx = (int)srcX;
+	sy = (int)srcY;
+	dx = (int)dstX;
+	dy = (int)dstY;
+	w = (int)width;
+	h = (int)height;
+	markDirty(dx, dx + w, dy, dy + h);
+	// Walk rows away from the direction of travel so overlapping rows are read before being written
+	for (int i = 0; i < h; ++i) {
+		const int row = dy > sy ? h - 1 - i : i;
+		memmove(targetRow(dy + row) + dx, targetRow(sy + row) + sx, w * 4);
+	}
+}
+
+// Rotates the contents of a rectangle by (dx, dy), wrapping what leaves one edge in at the other.
+// The rectangle is first clipped to the clip rectangle.
+void posiAPIScrollRect(int x, int y, int w, int h, int dx, int dy) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_SCROLL_RECT, 0, {x, y, w, h, dx, dy});
+		return;
+	}
+	const ClipRect& clip = clipRect;
+	const int x0 = std::max(x, clip.x0);
+	const int y0 = std::max(y, clip.y0);
+	const int x1 = (int)std::min<int64_t>((int64_t)x + w, clip.x1);
+	const int y1 = (int)std::min<int64_t>((int64_t)y + h, clip.y1);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	w = x1 - x0;
+	h = y1 - y0;
+	dx = ((dx % w) + w) % w;
+	dy = ((dy % h) + h) % h;
+	if (dx == 0 && dy == 0) {
+		return;
+	}
+	markDirty(x0, x1, y0, y1);
+	std::vector<uint32_t> copy((size_t)w * h);
+	for (int row = 0; row < h; ++row) {
+		memcpy(copy.data() + (size_t)row * w, targetRow(y0 + row) + x0, w * 4);
+	}
+	for (int row = 0; row < h; ++row) {
+		const uint32_t* src = copy.data() + (size_t)((row - dy + h) % h) * w;
+		uint32_t* dst = targetRow(y0 + row) + x0;
+		memcpy(dst + dx, src, (w - dx) * 4);
+		memcpy(dst, src + (w - dx), dx * 4);
+	}
+}
+
+
+// Returns one BGRA row of a tile. Rows of indexed pages are expanded through the page palette into scratch.
+static inline const uint32_t* tilePageRow(const TilePage& page, int tileInPage, int row, uint32_t* scratch) {
+	const int offset = tileInPage * tileSide * tileSide + row * tileSide;
+	switch (page.format) {
+		case TILE_PAGE_BGRA:
+			return page.pixels.data() + offset;
+		case TILE_PAGE_INDEXED: {
+			const uint8_t* indices = page.indices.data() + offset;
+			for (int i = 0; i < tileSide; ++i) {
+				scratch[i] = page.palette[indices[i]];
+			}
+			return scratch;
+		}
+		default:
+			return emptyTileRow.data();
+	}
+}
+
+static inline const uint32_t* tileRowPixels(int tileNum, int row, uint32_t* scratch) {
+	return tilePageRow(tilePages[tileNum / tilesPerPage], tileNum % tilesPerPage, row, scratch);
+}
+
+static void classifyTilePage(TilePage& page) {
+	for (int t = 0; t < tilesPerPage; ++t) {
+		int opaquePixels = 0;
+		uint64_t mask = 0;
+		GlyphMetrics glyph;
+		glyph.horzMin = tileSide;
+		for (int row = 0; row < tileSide; ++row) {
+			uint32_t scratch[tileSide];
+			const uint32_t* pixels = tilePageRow(page, t, row, scratch);
+			for (int px = 0; px < tileSide; ++px) {
+				if (pixels[px] & COLOR_ALPHA_MASK) {
+					++opaquePixels;
+					mask |= 1ull << (row * tileSide + px);
+				}
+				if (pixels[px] != 0) {
+					glyph.horzMin = std::min<int8_t>(glyph.horzMin, px);
+					glyph.horzMax = std::max<int8_t>(glyph.horzMax, px);
+					glyph.vertMax = row;
+				}
+			}
+		}
+		if (glyph.horzMax < 0) {
+			glyph.horzMin = 0;
+		}
+		page.opacity[t] = opaquePixels == 0 ? TILE_TRANSPARENT : (opaquePixels == tileSide * tileSide ? TILE_OPAQUE : TILE_MIXED);
+		page.glyphs[t] = glyph;
+		page.masks[t] = mask;
+	}
+}
+
+// One pixel of a tile, without expanding the rest of its row
+static inline uint32_t tilePagePixel(const TilePage& page, int tileInPage, int x, int y) {
+	const int offset = tileInPage * tileSide * tileSide + y * tileSide + x;
+	switch (page.format) {
+		case TILE_PAGE_BGRA:
+			return page.pixels[offset];
+		case TILE_PAGE_INDEXED:
+			return page.palette[page.indices[offset]];
+		default:
+			return 0;
+	}
 }
 
+static inline uint32_t tilePixel(int tileNum, int x, int y) {
+	uint32_t scratch[tileSide];
+	return tileRowPixels(tileNum, y, scratch)[x];
+}
 
 uint32_t gpuGetTilePagePixel(int pageNum, int x, int y) {
 	if(x < 0 || x >= 128 || y < 0 || y >= 128 || pageNum < 0 || pageNum >= numTilePages) {
 		return 0xFF000000;
 	}
-	auto pageStart = pageNum * tilesPerPage*tileSide*tileSide;
 	auto tileRow = y / 8;
 	auto tileCol = x / 8;
-	auto pxRow = y % 8;
-	auto pxCol = x % 8;
-	auto tileNum = tileRow * 16 + tileCol;
-	auto pxAddr = pxRow * 8 + pxCol;
-	auto pxAddress = pageStart + (tileNum * 64) + pxAddr;
-	return tiles[pxAddress];
+	auto tileNum = pageNum * tilesPerPage + tileRow * 16 + tileCol;
+	return tilePixel(tileNum, x % 8, y % 8);
 }
 
 uint32_t gpuGetTilePixel(int tileNum, int x, int y) {
 	if(x < 0 || x >= tileSide || y < 0 || y >= tileSide || tileNum < 0 || tileNum >= numTiles) {
 		return 0xFF000000;
 	}
-	auto pageNum = tileNum / tilesPerPage;
-	auto idRemainder = tileNum % tilesPerPage;
-	auto pageStart = pageNum * tilesPerPage*tileSide*tileSide;
-	auto tileStart = pageStart + idRemainder*64;
-	auto pxAddr = tileStart + (y * tileSide) + x;
-	return tiles[pxAddr];
-	
+	return tilePixel(tileNum, x, y);
+}
+
+uint32_t posiAPIGetTilePaletteColor(int pageNum, int index) {
+	if(pageNum < 0 || pageNum >= numTilePages || index < 0 || index >= tilePaletteSize || tilePages[pageNum].format != TILE_PAGE_INDEXED) {
+		return 0xFF000000;
+	}
+	return tilePages[pageNum].palette[index];
+}
+
+void posiAPISetTilePaletteColor(int pageNum, int index, uint32_t color) {
+	if(pageNum < 0 || pageNum >= numTilePages || index < 0 || index >= tilePaletteSize || tilePages[pageNum].format != TILE_PAGE_INDEXED) {
+		return;
+	}
+	auto& page = tilePages[pageNum];
+	const uint32_t oldColor = page.palette[index];
+	page.palette[index] = color;
+	// Only a change of visibility can move tiles between classes.
+	if (((oldColor & COLOR_ALPHA_MASK) == 0) != ((color & COLOR_ALPHA_MASK) == 0) || (oldColor == 0) != (color == 0)) {
+		classifyTilePage(page);
+	}
+	if (oldColor != color) {
+		invalidateTilemapCaches(pageNum);
+	}
 }
 
 void posiRedraw(uint32_t* buffer) {	
@@ -81,16 +717,25 @@ void gpuInit() {
     gpuClear();
 }
 
+// "tiles" blobs hold BGRA pixels. "itiles" blobs hold a BGRA palette followed by one index byte per pixel.
 void loadTilePages() {
 	for(auto i = 0; i< numTilePages; i++) {
+		auto& page = tilePages[i];
 		auto x = dbLoadByNumber("tiles", i);
-		if(!x || x->size() != pixelsPerPage*4) continue;
-		auto outputStart = tiles.data() + i * (pixelsPerPage);
-		uint32_t* dest = (uint32_t*)outputStart;
-		uint32_t* pixels = (uint32_t*)(x->data());
-		for (size_t i = 0; i < pixelsPerPage; i++) {
-			dest[i] = pixels[i];
-		}	
+		if(x && x->size() == pixelsPerPage*4) {
+			page.format = TILE_PAGE_BGRA;
+			page.pixels.resize(pixelsPerPage);
+			memcpy(page.pixels.data(), x->data(), pixelsPerPage*4);
+			classifyTilePage(page);
+			continue;
+		}
+		x = dbLoadByNumber("itiles", i);
+		if(x && x->size() == tilePaletteSize*4 + pixelsPerPage) {
+			page.format = TILE_PAGE_INDEXED;
+			memcpy(page.palette.data(), x->data(), tilePaletteSize*4);
+			page.indices.assign(x->begin() + tilePaletteSize*4, x->end());
+			classifyTilePage(page);
+		}
 	}	
 }
 
@@ -102,9 +747,31 @@ void loadTilemaps() {
 	}
 }
 
+// "tileflags" blobs hold one attribute byte per tile of a page
+void loadTileFlags() {
+	for(auto i = 0; i < numTilePages; i++) {
+		auto x = dbLoadByNumber("tileflags", i);
+		if(!x || x->size() != tilesPerPage) continue;
+		memcpy(tileFlags.data() + i * tilesPerPage, x->data(), tilesPerPage);
+	}
+}
+
 void gpuClear() {
 	frameBuffer.fill(0);
-	tiles.fill(0);
+	surfaces.fill(Surface{});
+	surfacePixelsUsed = 0;
+	drawTarget = {-1, frameBuffer.data(), screenWidth, screenHeight};
+	updateClipRect();
+	for (auto& cache : tilemapCaches) {
+		cache.reset();
+	}
+	markAllDirty();
+	gpuSetDrawState({});
+	drawListClear();
+	spriteTableClear();
+	scrollTables.fill({});
+	tilePages.fill(TilePage{});
+	tileFlags.fill(0);
 	for(int j = 0; j < numTilemaps; j++) {
 		tilemaps[j].fill(0);
 	}
@@ -115,14 +782,157 @@ void gpuReset() {
 	gpuLoad();
 }
 
+void gpuEndFrame() {
+	spriteTableSubmit();
+	drawListFlush();
+}
+
 void gpuLoad() {
 	loadTilePages();
 	loadTilemaps();
+	loadTileFlags();
+}
+
+// Copies one 8-pixel tile row. Unless the row is known to be opaque,
+// destination pixels are kept where the source alpha is zero.
+template<bool flipHorz, bool opaque>
+static inline void blitTileRow8(uint32_t* dst, const uint32_t* src) {
+	if constexpr (opaque && !flipHorz) {
+		memcpy(dst, src, tileSide * sizeof(uint32_t));
+		return;
+	}
+#if defined(__SSE2__)
+	const __m128i alphaMask = _mm_set1_epi32(COLOR_ALPHA_MASK);
+	const __m128i zero = _mm_setzero_si128();
+	for (int half = 0; half < 2; ++half) {
+		__m128i s;
+		if constexpr (flipHorz) {
+			s = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src + 4 - half * 4)), _MM_SHUFFLE(0, 1, 2, 3));
+		} else {
+			s = _mm_loadu_si128((const __m128i*)(src + half * 4));
+		}
+		if constexpr (opaque) {
+			_mm_storeu_si128((__m128i*)(dst + half * 4), s);
+			continue;
+		}
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + half * 4));
+		__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero);
+		__m128i result = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+		_mm_storeu_si128((__m128i*)(dst + half * 4), result);
+	}
+#else
+	for (int px = 0; px < tileSide; ++px) {
+		uint32_t color = src[flipHorz ? (tileSide - 1 - px) : px];
+		if (opaque || (color & COLOR_ALPHA_MASK)) {
+			dst[px] = color;
+		}
+	}
+#endif
+}
+
+// Copies the [px0, px1) part of a tile row, for tiles cut by the screen edge.
+template<bool flipHorz, bool opaque>
+static inline void blitTileRowPartial(uint32_t* dst, const uint32_t* src, int px0, int px1) {
+	for (int px = px0; px < px1; ++px) {
+		uint32_t color = src[flipHorz ? (tileSide - 1 - px) : px];
+		if (opaque || (color & COLOR_ALPHA_MASK)) {
+			dst[px - px0] = color;
+		}
+	}
+}
+
+template<bool flipHorz, bool opaque>
+static inline void blitTileRowSpan(uint32_t* dst, const uint32_t* src, int px0, int px1) {
+	if (px0 == 0 && px1 == tileSide) {
+		blitTileRow8<flipHorz, opaque>(dst, src);
+	} else {
+		blitTileRowPartial<flipHorz, opaque>(dst, src, px0, px1);
+	}
+}
+
+// Blends the [px0, px1) part of a tile row with the current blend mode.
+static inline void blendTileRow(uint32_t* dst, const uint32_t* src, int px0, int px1, bool flipHorz) {
+	uint32_t row[tileSide];
+	for (int px = px0; px < px1; ++px) {
+		row[px - px0] = src[flipHorz ? (tileSide - 1 - px) : px];
+	}
+	blendPixels(dst, row, px1 - px0);
+}
+
+static inline void blitTileRow(uint32_t* dst, const uint32_t* src, int px0, int px1, bool flipHorz, TileOpacity opacity) {
+	if (opacity != TILE_TRANSPARENT && blendMode != BLEND_OPAQUE) {
+		blendTileRow(dst, src, px0, px1, flipHorz);
+	} else if (opacity == TILE_OPAQUE) {
+		if (flipHorz) {
+			blitTileRowSpan<true, true>(dst, src, px0, px1);
+		} else {
+			blitTileRowSpan<false, true>(dst, src, px0, px1);
+		}
+	} else if (opacity == TILE_MIXED) {
+		if (flipHorz) {
+			blitTileRowSpan<true, false>(dst, src, px0, px1);
+		} else {
+			blitTileRowSpan<false, false>(dst, src, px0, px1);
+		}
+	}
+}
+
+// Draws a w x h block of tiles from one page. Flipping is applied per tile.
+// The sprite rectangle is clipped against the clip rectangle once, up front.
+template<bool flipHorz, bool flipVert>
+static void blitSprite(const TilePage& page, int startTileCol, int startTileRow, int w, int h, int x, int y) {
+	static constexpr int PAGE_GRID_WIDTH = 16;
+	const ClipRect& clip = clipRect;
+	const int x0 = std::max(x, clip.x0);
+	const int y0 = std::max(y, clip.y0);
+	// In 64 bits so a sprite placed near INT_MAX can't wrap around into view
+	const int x1 = (int)std::min<int64_t>((int64_t)x + w * tileSide, clip.x1);
+	const int y1 = (int)std::min<int64_t>((int64_t)y + h * tileSide, clip.y1);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	const int firstTx = (x0 - x) / tileSide;
+	const int lastTx = (x1 - 1 - x) / tileSide;
+	markDirty(x0, x1, y0, y1);
+
+	for (int screenY = y0; screenY < y1; ++screenY) {
+		const int ty = (screenY - y) / tileSide;
+		const int py = (screenY - y) % tileSide;
+		const int srcPixelY = flipVert ? (tileSide - 1 - py) : py;
+		const int rowTile = (startTileRow + ty) * PAGE_GRID_WIDTH + startTileCol;
+		uint32_t* dstRow = targetRow(screenY);
+
+		for (int tx = firstTx; tx <= lastTx; ++tx) {
+			const TileOpacity opacity = page.opacity[rowTile + tx];
+			if (opacity == TILE_TRANSPARENT) {
+				continue;
+			}
+			const int screenTileX = x + tx * tileSide;
+			const int px0 = std::max(x0 - screenTileX, 0);
+			const int px1 = std::min(x1 - screenTileX, tileSide);
+			uint32_t scratch[tileSide];
+			const uint32_t* src = tilePageRow(page, rowTile + tx, srcPixelY, scratch);
+			if (blendMode != BLEND_OPAQUE) {
+				blendTileRow(dstRow + screenTileX + px0, src, px0, px1, flipHorz);
+			} else if (opacity == TILE_OPAQUE) {
+				blitTileRowSpan<flipHorz, true>(dstRow + screenTileX + px0, src, px0, px1);
+			} else {
+				blitTileRowSpan<flipHorz, false>(dstRow + screenTileX + px0, src, px0, px1);
+			}
+		}
+	}
 }
 
 void posiAPIDrawSprite(int id, int w, int h, int x, int y, bool flipHorz, bool flipVert) {
 	static constexpr int PAGE_GRID_WIDTH = 16; 
 	static constexpr int PAGE_GRID_HEIGHT = 16; 
+    if (drawListRecording()) {
+        drawListRecord(DRAW_SPRITE, 0, {id, w, h, x, y, flipHorz, flipVert});
+        return;
+    }
+    x -= cameraX;
+    y -= cameraY;
     if (id < 0 || id >= numTiles || w <= 0 || h <= 0) {
         return;
     }
@@ -132,65 +942,36 @@ void posiAPIDrawSprite(int id, int w, int h, int x, int y, bool flipHorz, bool f
     const int startTileCol = idRemainder % PAGE_GRID_WIDTH; 
     const int startTileRow = idRemainder / PAGE_GRID_WIDTH;
 
-    if (startTileCol + w > PAGE_GRID_WIDTH) {
-        w = PAGE_GRID_WIDTH - startTileCol;
-    }
-    if (startTileRow + h > PAGE_GRID_HEIGHT) {
-        h = PAGE_GRID_HEIGHT - startTileRow;
-    }
-
-    for (int ty = 0; ty < h; ++ty) {
-        for (int tx = 0; tx < w; ++tx) { 
-
-            const int currentTileCol = startTileCol + tx;
-            const int currentTileRow = startTileRow + ty;
-            const int tileN = (currentTileRow * PAGE_GRID_WIDTH) + currentTileCol;
-
-            const int pageStart = pageNum * tilesPerPage * tileSide * tileSide;
-            const int tilePixelDataStart = pageStart + tileN * (tileSide * tileSide);
-
-            const int screenTileX = x + (tx * tileSide);
-            const int screenTileY = y + (ty * tileSide);
-
-            for (int py = 0; py < tileSide; ++py) { 
-                const int screenPixelY = screenTileY + py;
-
-                if (screenPixelY < 0 || screenPixelY >= screenHeight) {
-                    continue;
-                }
-                
-                for (int px = 0; px < tileSide; ++px) {
-                    const int screenPixelX = screenTileX + px;
-
-                    if (screenPixelX < 0 || screenPixelX >= screenWidth) {
-                        continue;
-                    }
-
-                    int srcPixelX = flipHorz ? (tileSide - 1 - px) : px;
-                    int srcPixelY = flipVert ? (tileSide - 1 - py) : py;
+    w = std::min(w, PAGE_GRID_WIDTH - startTileCol);
+    h = std::min(h, PAGE_GRID_HEIGHT - startTileRow);
 
-                    int colorPos = tilePixelDataStart + srcPixelY * tileSide + srcPixelX;
-                    int pixelColor = tiles[colorPos];
-
-                    posiPutPixel(screenPixelX, screenPixelY, pixelColor);
-                }
-            }
+    const TilePage& page = tilePages[pageNum];
+    if (page.format == TILE_PAGE_EMPTY) {
+        return;
+    }
+    if (flipHorz) {
+        if (flipVert) {
+            blitSprite<true, true>(page, startTileCol, startTileRow, w, h, x, y);
+        } else {
+            blitSprite<true, false>(page, startTileCol, startTileRow, w, h, x, y);
+        }
+    } else {
+        if (flipVert) {
+            blitSprite<false, true>(page, startTileCol, startTileRow, w, h, x, y);
+        } else {
+            blitSprite<false, false>(page, startTileCol, startTileRow, w, h, x, y);
         }
     }
 }
 
 
-uint16_t posiAPIGetTilemapEntry(int tilemapNum, int tmx, int tmy) {
-	if(tilemapNum < 0 ||tilemapNum >= numTilemaps||tmx<0||tmx>=tilemapTotalWidthTiles||tmy <0 || tmy >= tilemapTotalHeightTiles)
-		return 0;
-	auto r = tilemaps[tilemapNum][tmy*tilemapTotalWidthTiles+tmx];
-	return r;
-}
-
-void posiAPISetTilemapEntry(int tilemapNum, int tmx, int tmy,uint16_t entry){
-	if(tilemapNum < 0 ||tilemapNum >= numTilemaps||tmx<0||tmx>=tilemapTotalWidthTiles||tmy <0 || tmy >= tilemapTotalHeightTiles)
-		return;
-	tilemaps[tilemapNum][tmy*tilemapTotalWidthTiles+tmx] = entry;
+// Draws sprites in order, exactly as the same sequence of posiAPIDrawSprite calls would.
+void posiAPIDrawSprites(const SpriteDesc* sprites, int count) {
+	for (int i = 0; i < count; ++i) {
+		const SpriteDesc& sprite = sprites[i];
+		posiAPIDrawSprite(sprite.id, sprite.w, sprite.h, sprite.x, sprite.y,
+			(sprite.flags & spriteFlipHorz) != 0, (sprite.flags & spriteFlipVert) != 0);
+	}
 }
 
 int floor_div(int a, int b) {
@@ -198,122 +979,830 @@ int floor_div(int a, int b) {
     return (a % b != 0 && (a < 0) != (b < 0)) ? res - 1 : res;
 }
 
-void posiAPIDrawTilemap(int tilemapNum, int tmx, int tmy, int tmw, int tmh, int x, int y) {
-	static constexpr int TILE_FLIP_H_FLAG = 0x8000;
-	static constexpr int TILE_FLIP_V_FLAG = 0x4000;
-	static constexpr int TILE_ID_MASK     = 0x3FFF;
-    if (tilemapNum < 0 || tilemapNum >= numTilemaps) return;
-    if (tmw <= 0 || tmh <= 0) return;
-    int drawX = x;
-    int drawY = y;
-    int drawW = tmw;
-    int drawH = tmh;
-
-    int srcX = tmx;
-    int srcY = tmy;
-
-    if (drawX < 0) {
-        srcX += -drawX;
-        drawW -= -drawX;
-        drawX = 0;
-    }
-    if (drawY < 0) {
-        srcY += -drawY;
-        drawH -= -drawY;
-        drawY = 0;
-    }
-    if (drawX + drawW > screenWidth) {
-        drawW = screenWidth - drawX;
-    }
-    if (drawY + drawH > screenHeight) {
-        drawH = screenHeight - drawY;
-    }
-
-    if (drawW <= 0 || drawH <= 0) {
-        return;
-    }
-
-    int startTileX = floor_div(srcX, tileSide);
-    int startTileY = floor_div(srcY, tileSide);
-    int endTileX = floor_div(srcX + drawW - 1, tileSide);
-    int endTileY = floor_div(srcY + drawH - 1, tileSide);
+static inline int64_t floor_div64(int64_t a, int64_t b) {
+    int64_t res = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? res - 1 : res;
+}
 
-    for (int ty = startTileY; ty <= endTileY; ++ty) {
-        for (int tx = startTileX; tx <= endTileX; ++tx) {
-            int wrappedTileX = tx % tilemapTotalWidthTiles;
-            if (wrappedTileX < 0) wrappedTileX += tilemapTotalWidthTiles;
-            
-            int wrappedTileY = ty % tilemapTotalHeightTiles;
-            if (wrappedTileY < 0) wrappedTileY += tilemapTotalHeightTiles;
+// Mirrors a tile mask left to right by reversing the bits of every row byte
+static inline uint64_t flipMaskHorz(uint64_t m) {
+	m = ((m >> 1) & 0x5555555555555555ull) | ((m & 0x5555555555555555ull) << 1);
+	m = ((m >> 2) & 0x3333333333333333ull) | ((m & 0x3333333333333333ull) << 2);
+	return ((m >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((m & 0x0F0F0F0F0F0F0F0Full) << 4);
+}
 
-            int tileAddr = wrappedTileY * tilemapTotalWidthTiles + wrappedTileX;
-            int tileNum = tilemaps[tilemapNum][tileAddr];
-            int realTileNum = tileNum & TILE_ID_MASK;
-
-            if (realTileNum >= numTiles) continue;
-
-            bool flipH = (tileNum & TILE_FLIP_H_FLAG) != 0;
-            bool flipV = (tileNum & TILE_FLIP_V_FLAG) != 0;
-            
-            int screenTileX = drawX + (tx * tileSide) - srcX;
-            int screenTileY = drawY + (ty * tileSide) - srcY;
-
-            for (int pixelY = 0; pixelY < tileSide; ++pixelY) {
-                int finalScreenY = screenTileY + pixelY;
-
-                if (finalScreenY < drawY || finalScreenY >= drawY + drawH) continue;
-                
-                for (int pixelX = 0; pixelX < tileSide; ++pixelX) {
-                    int finalScreenX = screenTileX + pixelX;
-                    
-                    if (finalScreenX < drawX || finalScreenX >= drawX + drawW) continue;
-                    
-                    int srcPixelX = flipH ? (tileSide - 1 - pixelX) : pixelX;
-                    int srcPixelY = flipV ? (tileSide - 1 - pixelY) : pixelY;
-
-                    int pageNum = realTileNum / tilesPerPage;
-                    int idRemainder = realTileNum % tilesPerPage;
-                    int tileStart = (pageNum * tilesPerPage + idRemainder) * (tileSide * tileSide);
-                    int pixelPos = tileStart + srcPixelY * tileSide + srcPixelX;
-                    
-                    int color = tiles[pixelPos];
-
-                    posiPutPixel(finalScreenX, finalScreenY, color);
-                }
-            }
-        }
-    }
+// Moves a tile mask by (dx, dy) pixels, both in -7..7. Bits pushed past an edge are dropped.
+static inline uint64_t shiftMask(uint64_t m, int dx, int dy) {
+	static constexpr uint64_t EVERY_ROW = 0x0101010101010101ull;
+	if (dx > 0) {
+		m = (m << dx) & (EVERY_ROW * (uint8_t)(0xFF << dx));
+	} else if (dx < 0) {
+		m = (m >> -dx) & (EVERY_ROW * (0xFF >> -dx));
+	}
+	return dy >= 0 ? m << (dy * tileSide) : m >> (-dy * tileSide);
 }
 
+// The collision mask of tile (tx, ty) of a sprite, flipped the way posiAPIDrawSprite draws it
+static inline uint64_t spriteTileMask(const TilePage& page, int firstTile, int tx, int ty, uint32_t flags) {
+	static constexpr int PAGE_GRID_WIDTH = 16;
+	uint64_t m = page.masks[firstTile + ty * PAGE_GRID_WIDTH + tx];
+	if (flags & spriteFlipHorz) {
+		m = flipMaskHorz(m);
+	}
+	if (flags & spriteFlipVert) {
+		m = __builtin_bswap64(m);
+	}
+	return m;
+}
 
-void posiAPIDrawLine(int x1, int y1, int x2,int y2, uint32_t color) {
-	//x1 = std::clamp(x1,0,screenWidth-1);
-	//y1 = std::clamp(y1,0,screenHeight-1);
-	//x2 = std::clamp(x2,0,screenWidth-1);
-	//y2 = std::clamp(y2,0,screenHeight-1);
-	
-	int dx = std::abs(x2 - x1);
-    int dy = std::abs(y2 - y1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx - dy;
-
-    while (true) {
-        posiAPIPutPixel(x1, y1, color);
-        if (x1 == x2 && y1 == y2) break;
-        int e2 = 2 * err;
-        if (e2 > -dy) {
-            err = err - dy;
-            x1 = x1 + sx;
+// True if any non-transparent pixel of one sprite lands on one of the other, as they would be drawn
+// by posiAPIDrawSprite. Each pair of overlapping tiles is tested with a shift and an AND of their masks.
+bool posiAPISpritesOverlap(const SpriteDesc& a, const SpriteDesc& b) {
+	static constexpr int PAGE_GRID_WIDTH = 16;
+	static constexpr int PAGE_GRID_HEIGHT = 16;
+	struct Placed {
+		const TilePage* page;
+		int firstTile, w, h, x, y;
+		uint32_t flags;
+	};
+	auto place = [](const SpriteDesc& s, Placed& p) {
+		if (s.id < 0 || s.id >= numTiles || s.w <= 0 || s.h <= 0) {
+			return false;
+		}
+		p.page = &tilePages[s.id / tilesPerPage];
+		p.firstTile = s.id % tilesPerPage;
+		p.w = std::min<int>(s.w, PAGE_GRID_WIDTH - p.firstTile % PAGE_GRID_WIDTH);
+		p.h = std::min<int>(s.h, PAGE_GRID_HEIGHT - p.firstTile / PAGE_GRID_WIDTH);
+		p.x = s.x;
+		p.y = s.y;
+		p.flags = s.flags;
+		return p.page->format != TILE_PAGE_EMPTY;
+	};
+	Placed pa, pb;
+	if (!place(a, pa) || !place(b, pb)) {
+		return false;
+	}
+	const int x0 = std::max(pa.x, pb.x);
+	const int y0 = std::max(pa.y, pb.y);
+	const int x1 = std::min(pa.x + pa.w * tileSide, pb.x + pb.w * tileSide);
+	const int y1 = std::min(pa.y + pa.h * tileSide, pb.y + pb.h * tileSide);
+	if (x0 >= x1 || y0 >= y1) {
+		return false;
+	}
+	// Walk a's tiles inside the overlap and test each against the up to four tiles of b it covers
+	for (int aty = (y0 - pa.y) / tileSide; aty <= (y1 - 1 - pa.y) / tileSide; ++aty) {
+		for (int atx = (x0 - pa.x) / tileSide; atx <= (x1 - 1 - pa.x) / tileSide; ++atx) {
+			const uint64_t maskA = spriteTileMask(*pa.page, pa.firstTile, atx, aty, pa.flags);
+			if (maskA == 0) {
+				continue;
+			}
+			const int tileX = pa.x + atx * tileSide;
+			const int tileY = pa.y + aty * tileSide;
+			const int btx0 = std::max(floor_div(tileX - pb.x, tileSide), 0);
+			const int bty0 = std::max(floor_div(tileY - pb.y, tileSide), 0);
+			const int btx1 = std::min(floor_div(tileX + tileSide - 1 - pb.x, tileSide), pb.w - 1);
+			const int bty1 = std::min(floor_div(tileY + tileSide - 1 - pb.y, tileSide), pb.h - 1);
+			for (int bty = bty0; bty <= bty1; ++bty) {
+				for (int btx = btx0; btx <= btx1; ++btx) {
+					const uint64_t maskB = spriteTileMask(*pb.page, pb.firstTile, btx, bty, pb.flags);
+					const int dx = pb.x + btx * tileSide - tileX;
+					const int dy = pb.y + bty * tileSide - tileY;
+					if (maskA & shiftMask(maskB, dx, dy)) {
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// Draws a w x h tile sprite transformed by the 16.16 fixed-point matrix [a b; c d], with the
+// sprite's center placed at (x, y). Each destination pixel center is mapped back into the sprite
+// through the inverse matrix, stepping one column at a time; pixels with zero alpha are skipped.
+void posiAPIDrawSpriteAffine(int id, int w, int h, int x, int y, int32_t a, int32_t b, int32_t c, int32_t d) {
+	static constexpr int PAGE_GRID_WIDTH = 16;
+	static constexpr int PAGE_GRID_HEIGHT = 16;
+	if (drawListRecording()) {
+		drawListRecord(DRAW_SPRITE_AFFINE, 0, {id, w, h, x, y, a, b, c, d});
+		return;
+	}
+	x -= cameraX;
+	y -= cameraY;
+	if (id < 0 || id >= numTiles || w <= 0 || h <= 0) {
+		return;
+	}
+	const TilePage& page = tilePages[id / tilesPerPage];
+	const int startTileCol = id % tilesPerPage % PAGE_GRID_WIDTH;
+	const int startTileRow = id % tilesPerPage / PAGE_GRID_WIDTH;
+	w = std::min(w, PAGE_GRID_WIDTH - startTileCol);
+	h = std::min(h, PAGE_GRID_HEIGHT - startTileRow);
+	const double det = ((double)a * d - (double)b * c) / 65536.0 / 65536.0;
+	if (page.format == TILE_PAGE_EMPTY || det == 0.0) {
+		return;
+	}
+	const int srcW = w * tileSide;
+	const int srcH = h * tileSide;
+
+	// Screen bounding box of the transformed sprite, clipped once
+	double minX = 0, maxX = 0, minY = 0, maxY = 0;
+	for (int corner = 0; corner < 4; ++corner) {
+		const double u = (corner & 1 ? srcW : -srcW) / 2.0;
+		const double v = (corner & 2 ? srcH : -srcH) / 2.0;
+		const double sx = (a * u + b * v) / 65536.0;
+		const double sy = (c * u + d * v) / 65536.0;
+		minX = corner ? std::min(minX, sx) : sx;
+		maxX = corner ? std::max(maxX, sx) : sx;
+		minY = corner ? std::min(minY, sy) : sy;
+		maxY = corner ? std::max(maxY, sy) : sy;
+	}
+	const ClipRect& clip = clipRect;
+	const int x0 = (int)std::clamp<double>(std::floor(x + minX), clip.x0, clip.x1);
+	const int x1 = (int)std::clamp<double>(std::ceil(x + maxX), clip.x0, clip.x1);
+	const int y0 = (int)std::clamp<double>(std::floor(y + minY), clip.y0, clip.y1);
+	const int y1 = (int)std::clamp<double>(std::ceil(y + maxY), clip.y0, clip.y1);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	markDirty(x0, x1, y0, y1);
+
+	// Inverse matrix in 16.16
+	const int64_t ia = std::llround(d / 65536.0 / det * 65536.0);
+	const int64_t ib = std::llround(-b / 65536.0 / det * 65536.0);
+	const int64_t ic = std::llround(-c / 65536.0 / det * 65536.0);
+	const int64_t id_ = std::llround(a / 65536.0 / det * 65536.0);
+
+	// Source position of the center of pixel (x0, row), in 16.16. Each row starts from scratch
+	// so the result doesn't depend on which rows are clipped away.
+	const int64_t dx = ((int64_t)(x0 - x) << 16) + 0x8000;
+	for (int row = y0; row < y1; ++row) {
+		const int64_t dy = ((int64_t)(row - y) << 16) + 0x8000;
+		int64_t u = ((ia * dx + ib * dy) >> 16) + ((int64_t)srcW << 15);
+		int64_t v = ((ic * dx + id_ * dy) >> 16) + ((int64_t)srcH << 15);
+		uint32_t* dstRow = targetRow(row);
+		for (int col = x0; col < x1; ++col, u += ia, v += ic) {
+			const int su = (int)(u >> 16);
+			const int sv = (int)(v >> 16);
+			if ((unsigned)su >= (unsigned)srcW || (unsigned)sv >= (unsigned)srcH) {
+				continue;
+			}
+			const int tileInPage = (startTileRow + sv / tileSide) * PAGE_GRID_WIDTH + startTileCol + su / tileSide;
+			const uint32_t color = tilePagePixel(page, tileInPage, su % tileSide, sv % tileSide);
+			if (color & COLOR_ALPHA_MASK) {
+				plotPixel(dstRow + col, color);
+			}
+		}
+	}
+}
+
+// Returns the new surface's id, or -1 when all slots or the pixel budget are used up.
+// Surfaces start fully transparent and are at most the size of the screen.
+int posiAPICreateSurface(int w, int h) {
+	if (w <= 0 || h <= 0 || w > screenWidth || h > screenHeight || surfacePixelsUsed + w * h > surfacePixelBudget) {
+		return -1;
+	}
+	for (int id = 0; id < maxSurfaces; ++id) {
+		Surface& surface = surfaces[id];
+		if (surface.width == 0) {
+			surface.pixels.assign(w * h, 0);
+			surface.width = w;
+			surface.height = h;
+			surfacePixelsUsed += w * h;
+			return id;
+		}
+	}
+	return -1;
+}
+
+void posiAPIFreeSurface(int id) {
+	if (id < 0 || id >= maxSurfaces || surfaces[id].width == 0) {
+		return;
+	}
+	if (drawTarget.id == id) {
+		posiAPISetDrawTarget(-1);
+	}
+	surfacePixelsUsed -= surfaces[id].width * surfaces[id].height;
+	surfaces[id] = Surface{};
+}
+
+// Overwrites every pixel of a surface, alpha included, so it can be cleared to transparent.
+void posiAPIClearSurface(int id, uint32_t color) {
+	if (id < 0 || id >= maxSurfaces || surfaces[id].width == 0) {
+		return;
+	}
+	fillPixels(surfaces[id].pixels.data(), (int)surfaces[id].pixels.size(), color);
+}
+
+// -1 draws to the screen. Drawing to a surface is never deferred; only screen drawing is layered.
+void posiAPISetDrawTarget(int id) {
+	if (id >= 0 && id < maxSurfaces && surfaces[id].width != 0) {
+		Surface& surface = surfaces[id];
+		drawTarget = {id, surface.pixels.data(), surface.width, surface.height};
+	} else {
+		drawTarget = {-1, frameBuffer.data(), screenWidth, screenHeight};
+	}
+	updateClipRect();
+}
+
+int gpuGetDrawTarget() {
+	return drawTarget.id;
+}
+
+// Copies the sw x sh area at (sx, sy) of a surface to (x, y) of the draw target with the current
+// blend mode, skipping transparent pixels like a sprite.
+void posiAPIDrawSurface(int id, int sx, int sy, int sw, int sh, int x, int y) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_SURFACE, 0, {id, sx, sy, sw, sh, x, y});
+		return;
+	}
+	x -= cameraX;
+	y -= cameraY;
+	if (id < 0 || id >= maxSurfaces || surfaces[id].width == 0 || id == drawTarget.id) {
+		return;
+	}
+	const Surface& surface = surfaces[id];
+	if (sx < 0) {
+		x -= sx;
+		sw += sx;
+		sx = 0;
+	}
+	if (sy < 0) {
+		y -= sy;
+		sh += sy;
+		sy = 0;
+	}
+	sw = std::min(sw, surface.width - sx);
+	sh = std::min(sh, surface.height - sy);
+
+	const ClipRect& clip = clipRect;
+	if (x < clip.x0) {
+		sx += clip.x0 - x;
+		sw -= clip.x0 - x;
+		x = clip.x0;
+	}
+	if (y < clip.y0) {
+		sy += clip.y0 - y;
+		sh -= clip.y0 - y;
+		y = clip.y0;
+	}
+	sw = std::min(sw, clip.x1 - x);
+	sh = std::min(sh, clip.y1 - y);
+	if (sw <= 0 || sh <= 0) {
+		return;
+	}
+	markDirty(x, x + sw, y, y + sh);
+	for (int row = 0; row < sh; ++row) {
+		blendPixels(targetRow(y + row) + x, surface.pixels.data() + (sy + row) * surface.width + sx, sw);
+	}
+}
+
+uint16_t posiAPIGetTilemapEntry(int tilemapNum, int tmx, int tmy) {
+	if(tilemapNum < 0 ||tilemapNum >= numTilemaps||tmx<0||tmx>=tilemapTotalWidthTiles||tmy <0 || tmy >= tilemapTotalHeightTiles)
+		return 0;
+	auto r = tilemaps[tilemapNum][tmy*tilemapTotalWidthTiles+tmx];
+	return r;
+}
+
+void posiAPISetTilemapEntry(int tilemapNum, int tmx, int tmy,uint16_t entry){
+	if(tilemapNum < 0 ||tilemapNum >= numTilemaps||tmx<0||tmx>=tilemapTotalWidthTiles||tmy <0 || tmy >= tilemapTotalHeightTiles)
+		return;
+	tilemaps[tilemapNum][tmy*tilemapTotalWidthTiles+tmx] = entry;
+	if (auto& cache = tilemapCaches[tilemapNum]) {
+		cache->valid[tmy*tilemapTotalWidthTiles+tmx] = 0;
+	}
+}
+
+uint8_t posiAPIGetTileFlags(int tileNum) {
+	if (tileNum < 0 || tileNum >= numTiles) {
+		return 0;
+	}
+	return tileFlags[tileNum];
+}
+
+void posiAPISetTileFlags(int tileNum, uint8_t flags) {
+	if (tileNum < 0 || tileNum >= numTiles) {
+		return;
+	}
+	tileFlags[tileNum] = flags;
+}
+
+// Attribute flags of a tilemap cell; cells outside the tilemap have none
+static inline int tilemapCellFlags(const std::array<uint16_t, tilemapTotalTiles>& tilemap, int tmx, int tmy) {
+	if (tmx < 0 || tmx >= tilemapTotalWidthTiles || tmy < 0 || tmy >= tilemapTotalHeightTiles) {
+		return 0;
+	}
+	return tileFlags[tilemap[tmy * tilemapTotalWidthTiles + tmx] & TILE_ID_MASK];
+}
+
+// The tilemap queries below take positions in tilemap pixels and only look at flags in mask.
+
+// Returns the flags of all tiles touched by the rectangle, ORed together
+int posiAPITilemapFlagsInRect(int tilemapNum, int x, int y, int w, int h, int mask) {
+	if (tilemapNum < 0 || tilemapNum >= numTilemaps || w <= 0 || h <= 0) {
+		return 0;
+	}
+	const auto& tilemap = tilemaps[tilemapNum];
+	const int tx0 = std::max(floor_div(x, tileSide), 0);
+	const int ty0 = std::max(floor_div(y, tileSide), 0);
+	const int tx1 = std::min(floor_div(x + w - 1, tileSide), tilemapTotalWidthTiles - 1);
+	const int ty1 = std::min(floor_div(y + h - 1, tileSide), tilemapTotalHeightTiles - 1);
+	int found = 0;
+	for (int ty = ty0; ty <= ty1; ++ty) {
+		const uint16_t* row = tilemap.data() + ty * tilemapTotalWidthTiles;
+		for (int tx = tx0; tx <= tx1; ++tx) {
+			found |= tileFlags[row[tx] & TILE_ID_MASK];
+		}
+		if ((found & mask) == mask) {
+			break;
+		}
+	}
+	return found & mask;
+}
+
+// Walks the tiles crossed by the segment from pixel (x0, y0) to pixel (x1, y1), through pixel centers,
+// and stores the first one with a flag in mask. Returns false if there is none.
+// Finds the cell where a segment in doubled coordinates enters the map through the edge across
+// axis a, resolving axis b the way the walk in posiAPITilemapRaycast breaks ties.
+// Returns false if the segment doesn't cross that edge within the map.
+static bool raycastEntryCell(int64_t startA, int64_t deltaA, int64_t startB, int64_t deltaB, int cellsA, int cellsB, int& cellA, int& cellB) {
+	static constexpr int64_t TILE_EDGE = tileSide * 2;
+	const int64_t edgeA = deltaA > 0 ? 0 : cellsA * TILE_EDGE;
+	if (deltaA > 0 ? (startA >= edgeA || startA + deltaA <= edgeA) : (deltaA == 0 || startA <= edgeA || startA + deltaA >= edgeA)) {
+		return false;
+	}
+	const int64_t lengthA = std::abs(deltaA);
+	const int64_t along = std::abs(edgeA - startA);
+	// Checked roughly first; near the map, b * lengthA at the crossing fits in 64 bits, so the
+	// wrapping products below give it exactly
+	const double roughB = startB + (double)along * deltaB / lengthA;
+	if (roughB < -TILE_EDGE || roughB > (cellsB + 1) * TILE_EDGE) {
+		return false;
+	}
+	const int64_t scaledB = (int64_t)((uint64_t)startB * (uint64_t)lengthA + (uint64_t)along * (uint64_t)deltaB);
+	const int64_t cellSpan = TILE_EDGE * lengthA;
+	const int64_t b = deltaB < 0 ? -floor_div64(-scaledB, cellSpan) - 1 : floor_div64(scaledB, cellSpan);
+	if (b < 0 || b >= cellsB) {
+		return false;
+	}
+	cellA = deltaA > 0 ? 0 : cellsA - 1;
+	cellB = (int)b;
+	return true;
+}
+
+bool posiAPITilemapRaycast(int tilemapNum, int x0, int y0, int x1, int y1, int mask, int& hitTx, int& hitTy) {
+	if (tilemapNum < 0 || tilemapNum >= numTilemaps) {
+		return false;
+	}
+	const auto& tilemap = tilemaps[tilemapNum];
+	// Doubled coordinates put pixel centers and tile edges on integers
+	static constexpr int64_t TILE_EDGE = tileSide * 2;
+	const int64_t startX = 2 * (int64_t)x0 + 1;
+	const int64_t startY = 2 * (int64_t)y0 + 1;
+	const int64_t lengthX = std::abs(2 * ((int64_t)x1 - x0));
+	const int64_t lengthY = std::abs(2 * ((int64_t)y1 - y0));
+	const int stepX = x1 > x0 ? 1 : (x1 < x0 ? -1 : 0);
+	const int stepY = y1 > y0 ? 1 : (y1 < y0 ? -1 : 0);
+	int tx = floor_div(x0, tileSide);
+	int ty = floor_div(y0, tileSide);
+	const int endTx = floor_div(x1, tileSide);
+	const int endTy = floor_div(y1, tileSide);
+	// A segment starting outside the map is clipped to it, so the walk starts where it enters
+	// instead of stepping through every empty cell on the way
+	const bool outsideX = tx < 0 || tx >= tilemapTotalWidthTiles;
+	const bool outsideY = ty < 0 || ty >= tilemapTotalHeightTiles;
+	if (outsideX || outsideY) {
+		const int64_t deltaX = 2 * ((int64_t)x1 - x0);
+		const int64_t deltaY = 2 * ((int64_t)y1 - y0);
+		if (!(outsideX && raycastEntryCell(startX, deltaX, startY, deltaY, tilemapTotalWidthTiles, tilemapTotalHeightTiles, tx, ty))
+			&& !(outsideY && raycastEntryCell(startY, deltaY, startX, deltaX, tilemapTotalHeightTiles, tilemapTotalWidthTiles, ty, tx))) {
+			return false;
+		}
+	}
+	for (;;) {
+		if (tilemapCellFlags(tilemap, tx, ty) & mask) {
+			hitTx = tx;
+			hitTy = ty;
+			return true;
+		}
+		if ((tx == endTx && ty == endTy)
+			|| (tx < 0 && stepX <= 0) || (tx >= tilemapTotalWidthTiles && stepX >= 0)
+			|| (ty < 0 && stepY <= 0) || (ty >= tilemapTotalHeightTiles && stepY >= 0)) {
+			return false;
+		}
+		// Distance to the next tile edge on each axis, compared as fractions of the segment. The
+		// products can overflow on long segments, but for a cell on the segment their difference
+		// is small, so it is taken in wrapping arithmetic.
+		const int64_t toEdgeX = stepX > 0 ? (tx + 1) * TILE_EDGE - startX : startX - tx * TILE_EDGE;
+		const int64_t toEdgeY = stepY > 0 ? (ty + 1) * TILE_EDGE - startY : startY - ty * TILE_EDGE;
+		const int64_t order = (int64_t)((uint64_t)toEdgeX * (uint64_t)lengthY - (uint64_t)toEdgeY * (uint64_t)lengthX);
+		if (stepX && (!stepY || order <= 0) && tx != endTx) {
+			tx += stepX;
+		}
+		if (stepY && (!stepX || order >= 0) && ty != endTy) {
+			ty += stepY;
+		}
+	}
+}
+
+// Scans down from row y over the columns [x, x + w) for at most maxDistance pixels and returns the
+// top row of the first tile with a flag in mask, which is above y when y is inside such a tile.
+// Returns -1 if there is none.
+int posiAPITilemapGroundHeight(int tilemapNum, int x, int y, int w, int maxDistance, int mask) {
+	if (tilemapNum < 0 || tilemapNum >= numTilemaps || w <= 0 || maxDistance < 0) {
+		return -1;
+	}
+	const auto& tilemap = tilemaps[tilemapNum];
+	const int tx0 = std::max(floor_div(x, tileSide), 0);
+	const int tx1 = (int)std::min<int64_t>(floor_div64((int64_t)x + w - 1, tileSide), tilemapTotalWidthTiles - 1);
+	const int ty0 = std::max(floor_div(y, tileSide), 0);
+	const int ty1 = (int)std::min<int64_t>(floor_div64((int64_t)y + maxDistance, tileSide), tilemapTotalHeightTiles - 1);
+	for (int ty = ty0; ty <= ty1; ++ty) {
+		const uint16_t* row = tilemap.data() + ty * tilemapTotalWidthTiles;
+		for (int tx = tx0; tx <= tx1; ++tx) {
+			if (tileFlags[row[tx] & TILE_ID_MASK] & mask) {
+				return ty * tileSide;
+			}
+		}
+	}
+	return -1;
+}
+
+// Turning the cache on costs 16MB for the tilemap; turning it off frees it. Returns whether the
+// tilemap is cached afterwards, which is false when maxCachedTilemaps are already cached.
+bool posiAPISetTilemapCached(int tilemapNum, bool cached) {
+	if (tilemapNum < 0 || tilemapNum >= numTilemaps) {
+		return false;
+	}
+	auto& cache = tilemapCaches[tilemapNum];
+	if (!cached) {
+		cache.reset();
+		return false;
+	}
+	if (!cache) {
+		const auto numCached = std::count_if(tilemapCaches.begin(), tilemapCaches.end(), [](const auto& c) { return c != nullptr; });
+		if (numCached >= maxCachedTilemaps) {
+			return false;
+		}
+		cache = std::make_unique<TilemapCache>();
+	}
+	return true;
+}
+
+// Renders one cell of a tilemap into its cache, applying the entry's flips.
+static void renderTilemapCacheCell(TilemapCache& cache, int tilemapNum, int tileX, int tileY) {
+	const int cell = tileY * tilemapTotalWidthTiles + tileX;
+	const int tileNum = tilemaps[tilemapNum][cell];
+	const int realTileNum = tileNum & TILE_ID_MASK;
+	const bool flipH = (tileNum & TILE_FLIP_H_FLAG) != 0;
+	const bool flipV = (tileNum & TILE_FLIP_V_FLAG) != 0;
+	const TilePage* page = realTileNum < numTiles ? &tilePages[realTileNum / tilesPerPage] : nullptr;
+	const int tileInPage = realTileNum % tilesPerPage;
+	uint32_t* dst = cache.pixels.data() + tileY * tileSide * tilemapCacheWidth + tileX * tileSide;
+	for (int row = 0; row < tileSide; ++row, dst += tilemapCacheWidth) {
+		uint32_t scratch[tileSide];
+		const uint32_t* src = page ? tilePageRow(*page, tileInPage, flipV ? (tileSide - 1 - row) : row, scratch) : emptyTileRow.data();
+		for (int px = 0; px < tileSide; ++px) {
+			dst[px] = src[flipH ? (tileSide - 1 - px) : px];
+		}
+	}
+	cache.opacity[cell] = page ? page->opacity[tileInPage] : TILE_TRANSPARENT;
+	cache.valid[cell] = 1;
+}
+
+void posiAPIDrawTilemap(int tilemapNum, int tmx, int tmy, int tmw, int tmh, int x, int y) {
+    if (drawListRecording()) {
+        drawListRecord(DRAW_TILEMAP, 0, {tilemapNum, tmx, tmy, tmw, tmh, x, y});
+        return;
+    }
+    if (tilemapNum < 0 || tilemapNum >= numTilemaps) return;
+    if (tmw <= 0 || tmh <= 0) return;
+    // Clipped in 64 bits so positions and sizes near INT_MAX can't wrap around into view
+    const int64_t targetX = (int64_t)x - cameraX;
+    const int64_t targetY = (int64_t)y - cameraY;
+    const ClipRect& clip = clipRect;
+    const int64_t x0 = std::max<int64_t>(targetX, clip.x0);
+    const int64_t y0 = std::max<int64_t>(targetY, clip.y0);
+    const int64_t x1 = std::min<int64_t>(targetX + tmw, clip.x1);
+    const int64_t y1 = std::min<int64_t>(targetY + tmh, clip.y1);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    const int drawX = (int)x0;
+    const int drawY = (int)y0;
+    const int drawW = (int)(x1 - x0);
+    const int drawH = (int)(y1 - y0);
+
+    // The map wraps, so the source origin is reduced into it to keep the tile maths in range
+    constexpr int64_t mapPixelWidth = tilemapTotalWidthTiles * tileSide;
+    constexpr int64_t mapPixelHeight = tilemapTotalHeightTiles * tileSide;
+    const int64_t srcLeft = tmx + (x0 - targetX);
+    const int64_t srcTop = tmy + (y0 - targetY);
+    const int srcX = (int)(srcLeft - floor_div64(srcLeft, mapPixelWidth) * mapPixelWidth);
+    const int srcY = (int)(srcTop - floor_div64(srcTop, mapPixelHeight) * mapPixelHeight);
+
+    markDirty(drawX, drawX + drawW, drawY, drawY + drawH);
+
+    // Horizontal layout of the visible tile columns doesn't change from row to row,
+    // so the partial first and last spans are worked out once.
+    struct TileColumn {
+        int wrappedTileX;
+        int px0, px1;
+        int screenX;
+    };
+    struct TileEntry {
+        const TilePage* page;
+        int tileInPage;
+        TileOpacity opacity;
+        bool flipH, flipV;
+    };
+    std::array<TileColumn, tilemapScreenWidthTiles + 1> columns;
+    std::array<TileEntry, tilemapScreenWidthTiles + 1> entries;
+
+    const int startTileX = floor_div(srcX, tileSide);
+    const int endTileX = floor_div(srcX + drawW - 1, tileSide);
+    const int numColumns = std::min<int>(endTileX - startTileX + 1, columns.size());
+    for (int c = 0; c < numColumns; ++c) {
+        const int tx = startTileX + c;
+        int wrappedTileX = tx % tilemapTotalWidthTiles;
+        if (wrappedTileX < 0) wrappedTileX += tilemapTotalWidthTiles;
+        const int tilePixelX = tx * tileSide;
+        columns[c].wrappedTileX = wrappedTileX;
+        columns[c].px0 = std::max(srcX - tilePixelX, 0);
+        columns[c].px1 = std::min(srcX + drawW - tilePixelX, tileSide);
+        columns[c].screenX = drawX + tilePixelX - srcX + columns[c].px0;
+    }
+
+    if (TilemapCache* cache = tilemapCaches[tilemapNum].get()) {
+        const int startTileY = floor_div(srcY, tileSide);
+        const int endTileY = floor_div(srcY + drawH - 1, tileSide);
+        {
+            std::lock_guard lock(tilemapCacheMutex);
+            for (int ty = startTileY; ty <= endTileY; ++ty) {
+                int wrappedTileY = ty % tilemapTotalHeightTiles;
+                if (wrappedTileY < 0) wrappedTileY += tilemapTotalHeightTiles;
+                for (int c = 0; c < numColumns; ++c) {
+                    if (!cache->valid[wrappedTileY * tilemapTotalWidthTiles + columns[c].wrappedTileX]) {
+                        renderTilemapCacheCell(*cache, tilemapNum, columns[c].wrappedTileX, wrappedTileY);
+                    }
+                }
+            }
         }
-        if (e2 < dx) {
-            err = err + dx;
-            y1 = y1 + sy;
+
+        // Neighbouring opaque cells are adjacent in the cache unless the map wraps between them,
+        // so their rows are copied as one run.
+        for (int row = 0; row < drawH; ++row) {
+            int sy = (srcY + row) % (tilemapTotalHeightTiles * tileSide);
+            if (sy < 0) sy += tilemapTotalHeightTiles * tileSide;
+            const uint32_t* cacheRow = cache->pixels.data() + sy * tilemapCacheWidth;
+            const TileOpacity* opacityRow = cache->opacity.data() + (sy / tileSide) * tilemapTotalWidthTiles;
+            uint32_t* dstRow = targetRow(drawY + row);
+            uint32_t* runDst = nullptr;
+            const uint32_t* runSrc = nullptr;
+            int runLength = 0;
+            for (int c = 0; c < numColumns; ++c) {
+                const TileColumn& column = columns[c];
+                const TileOpacity opacity = opacityRow[column.wrappedTileX];
+                const uint32_t* src = cacheRow + column.wrappedTileX * tileSide;
+                if (opacity == TILE_OPAQUE && blendMode == BLEND_OPAQUE) {
+                    if (runLength > 0 && runSrc + runLength == src + column.px0) {
+                        runLength += column.px1 - column.px0;
+                        continue;
+                    }
+                    if (runLength > 0) {
+                        memcpy(runDst, runSrc, runLength * 4);
+                    }
+                    runDst = dstRow + column.screenX;
+                    runSrc = src + column.px0;
+                    runLength = column.px1 - column.px0;
+                    continue;
+                }
+                blitTileRow(dstRow + column.screenX, src, column.px0, column.px1, false, opacity);
+            }
+            if (runLength > 0) {
+                memcpy(runDst, runSrc, runLength * 4);
+            }
+        }
+        return;
+    }
+
+    int resolvedTileY = 0;
+    bool rowResolved = false;
+    for (int row = 0; row < drawH; ++row) {
+        const int sy = srcY + row;
+        const int ty = floor_div(sy, tileSide);
+        const int pixelY = sy - ty * tileSide;
+
+        if (!rowResolved || ty != resolvedTileY) {
+            int wrappedTileY = ty % tilemapTotalHeightTiles;
+            if (wrappedTileY < 0) wrappedTileY += tilemapTotalHeightTiles;
+            const uint16_t* mapRow = tilemaps[tilemapNum].data() + wrappedTileY * tilemapTotalWidthTiles;
+            for (int c = 0; c < numColumns; ++c) {
+                const int tileNum = mapRow[columns[c].wrappedTileX];
+                const int realTileNum = tileNum & TILE_ID_MASK;
+                const TilePage* page = realTileNum < numTiles ? &tilePages[realTileNum / tilesPerPage] : nullptr;
+                entries[c].tileInPage = realTileNum % tilesPerPage;
+                entries[c].opacity = page ? page->opacity[entries[c].tileInPage] : TILE_TRANSPARENT;
+                entries[c].page = entries[c].opacity != TILE_TRANSPARENT ? page : nullptr;
+                entries[c].flipH = (tileNum & TILE_FLIP_H_FLAG) != 0;
+                entries[c].flipV = (tileNum & TILE_FLIP_V_FLAG) != 0;
+            }
+            resolvedTileY = ty;
+            rowResolved = true;
+        }
+
+        uint32_t* dstRow = targetRow(drawY + row);
+        for (int c = 0; c < numColumns; ++c) {
+            const TileEntry& entry = entries[c];
+            if (!entry.page) continue;
+            const int srcPixelY = entry.flipV ? (tileSide - 1 - pixelY) : pixelY;
+            const TileColumn& column = columns[c];
+            uint32_t scratch[tileSide];
+            const uint32_t* src = tilePageRow(*entry.page, entry.tileInPage, srcPixelY, scratch);
+            blitTileRow(dstRow + column.screenX, src, column.px0, column.px1, entry.flipH, entry.opacity);
         }
     }
 }
 
+
+void posiAPISetScrollLine(int table, int line, int dx, int dy) {
+	if (table < 0 || table >= numScrollTables || line < 0 || line >= screenHeight) {
+		return;
+	}
+	scrollTables[table][line] = {dx, dy};
+}
+
+// Like posiAPIDrawTilemap, but each destination row y is taken from the map offset by line y of
+// the scroll table, so parallax and wave effects need one call per layer instead of one per line.
+void posiAPIDrawTilemapScanlines(int table, int tilemapNum, int tmx, int tmy, int tmw, int tmh, int x, int y) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_TILEMAP_SCANLINES, 0, {table, tilemapNum, tmx, tmy, tmw, tmh, x, y});
+		return;
+	}
+	if (table < 0 || table >= numScrollTables) {
+		return;
+	}
+	// Rows are looked up in target space; posiAPIDrawTilemap applies the camera itself
+	// In 64 bits, with the source reduced into the wrapping map, so nothing here can overflow
+	constexpr int64_t mapPixelWidth = tilemapTotalWidthTiles * tileSide;
+	constexpr int64_t mapPixelHeight = tilemapTotalHeightTiles * tileSide;
+	const int64_t targetY = (int64_t)y - cameraY;
+	const int y0 = (int)std::max<int64_t>(targetY, clipRect.y0);
+	const int y1 = (int)std::min<int64_t>(targetY + tmh, clipRect.y1);
+	for (int row = y0; row < y1; ++row) {
+		const ScrollLine& line = scrollTables[table][row];
+		const int64_t sx = (int64_t)tmx + line.dx;
+		const int64_t sy = tmy + (row - targetY) + line.dy;
+		posiAPIDrawTilemap(tilemapNum, (int)(sx - floor_div64(sx, mapPixelWidth) * mapPixelWidth),
+			(int)(sy - floor_div64(sy, mapPixelHeight) * mapPixelHeight), tmw, 1, x, row + cameraY);
+	}
+}
+
+// Draws a tilemap as a ground plane seen in perspective, every target row below the horizon
+// being one line of the plane. camX, camY (map pixels), angle (radians, 0 looks towards -y) and
+// height are 16.16 fixed point; focal is the distance from the eye to the screen in pixels.
+// Each row gets its own scale, height / (row - horizon), and is stepped in 16.16 from its left
+// end. Outside the map the plane either wraps or repeats the edge pixels.
+void posiAPIDrawMode7(int tilemapNum, int32_t camX, int32_t camY, int32_t angle, int32_t height, int horizon, int focal, int edge) {
+	static constexpr int MAP_PIXEL_WIDTH = tilemapTotalWidthTiles * tileSide;
+	static constexpr int MAP_PIXEL_HEIGHT = tilemapTotalHeightTiles * tileSide;
+	if (drawListRecording()) {
+		drawListRecord(DRAW_MODE7, 0, {tilemapNum, camX, camY, angle, height, horizon, focal, edge});
+		return;
+	}
+	if (tilemapNum < 0 || tilemapNum >= numTilemaps || focal <= 0) {
+		return;
+	}
+	const ClipRect& clip = clipRect;
+	if (horizon >= clip.y1 - 1 || clip.x0 >= clip.x1) {
+		return;
+	}
+	const int y0 = std::max(horizon + 1, clip.y0);
+	markDirty(clip.x0, clip.x1, y0, clip.y1);
+
+	const double radians = angle / 65536.0;
+	const int64_t cosA = std::llround(std::cos(radians) * 65536.0);
+	const int64_t sinA = std::llround(std::sin(radians) * 65536.0);
+	const auto& map = tilemaps[tilemapNum];
+	const int twiceCenterX = drawTarget.width;
+
+	for (int row = y0; row < clip.y1; ++row) {
+		// Map pixels per screen pixel on this row, and distance to the row along the view direction
+		const int64_t scale = height / ((int64_t)row - horizon);
+		const int64_t stepU = (scale * cosA) >> 16;
+		const int64_t stepV = (scale * sinA) >> 16;
+		const int64_t offset = 2 * clip.x0 + 1 - twiceCenterX;
+		// In double, since with large heights and focal lengths these products pass 64 bits; exact
+		// below 2^53, and clamped far enough out that only the map's wrapping or clamping shows
+		const double distance = (double)scale * focal;
+		const int64_t alongU = (int64_t)std::clamp(std::floor(distance * sinA / 65536.0), -0x1p62, 0x1p62);
+		const int64_t alongV = (int64_t)std::clamp(std::floor(distance * cosA / 65536.0), -0x1p62, 0x1p62);
+		int64_t u = camX + alongU + ((offset * stepU) >> 1);
+		int64_t v = camY - alongV + ((offset * stepV) >> 1);
+		uint32_t* dstRow = targetRow(row);
+		for (int col = clip.x0; col < clip.x1; ++col, u += stepU, v += stepV) {
+			int mapX = (int)(u >> 16);
+			int mapY = (int)(v >> 16);
+			if (edge == MODE7_CLAMP) {
+				mapX = std::clamp(mapX, 0, MAP_PIXEL_WIDTH - 1);
+				mapY = std::clamp(mapY, 0, MAP_PIXEL_HEIGHT - 1);
+			} else {
+				mapX &= MAP_PIXEL_WIDTH - 1;
+				mapY &= MAP_PIXEL_HEIGHT - 1;
+			}
+			const int tileNum = map[(mapY / tileSide) * tilemapTotalWidthTiles + mapX / tileSide];
+			const int realTileNum = tileNum & TILE_ID_MASK;
+			if (realTileNum >= numTiles) {
+				continue;
+			}
+			int px = mapX % tileSide;
+			int py = mapY % tileSide;
+			if (tileNum & TILE_FLIP_H_FLAG) px = tileSide - 1 - px;
+			if (tileNum & TILE_FLIP_V_FLAG) py = tileSide - 1 - py;
+			const uint32_t color = tilePagePixel(tilePages[realTileNum / tilesPerPage], realTileNum % tilesPerPage, px, py);
+			if (color & COLOR_ALPHA_MASK) {
+				plotPixel(dstRow + col, color);
+			}
+		}
+	}
+}
+
+void posiAPIDrawLine(int x1, int y1, int x2,int y2, uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_LINE, color, {x1, y1, x2, y2});
+		return;
+	}
+	x1 -= cameraX;
+	y1 -= cameraY;
+	x2 -= cameraX;
+	y2 -= cameraY;
+	if (outsideClip(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2))) {
+		return;
+	}
+	if (y1 == y2) {
+		fillSpan(x1, x2, y1, color);
+		return;
+	}
+	if (x1 == x2) {
+		fillColumn(x1, y1, y2, color);
+		return;
+	}
+
+	// Run-slice Bresenham. The line steps once along its major axis per pixel, and after k steps it
+	// has stepped m = ceil((2*k*minor - major) / (2*major)) times along the minor axis (never below 0).
+	// Inverting that gives the run of major steps spent at each minor offset, so every run is one span
+	// or column, and only the minor offsets inside the clip rectangle are visited. The pixels are the
+	// same as the classic error-accumulating loop's.
+	const bool xMajor = std::abs(x2 - x1) >= std::abs(y2 - y1);
+	const int majorStart = xMajor ? x1 : y1;
+	const int minorStart = xMajor ? y1 : x1;
+	const int majorStep = (xMajor ? x2 > x1 : y2 > y1) ? 1 : -1;
+	const int minorStep = (xMajor ? y2 > y1 : x2 > x1) ? 1 : -1;
+	const int64_t major = xMajor ? std::abs(x2 - x1) : std::abs(y2 - y1);
+	const int64_t minor = xMajor ? std::abs(y2 - y1) : std::abs(x2 - x1);
+	const ClipRect& clip = clipRect;
+	const int minorClip0 = xMajor ? clip.y0 : clip.x0;
+	const int minorClip1 = xMajor ? clip.y1 : clip.x1;
+	const int majorClip0 = xMajor ? clip.x0 : clip.y0;
+	const int majorClip1 = xMajor ? clip.x1 : clip.y1;
+
+	// Offsets [first, last] along an axis from start, in step's direction, that land in [clip0, clip1)
+	auto clipOffsets = [](int start, int step, int clip0, int clip1, int64_t& first, int64_t& last) {
+		first = step > 0 ? (int64_t)clip0 - start : (int64_t)start - (clip1 - 1);
+		last = step > 0 ? (int64_t)clip1 - 1 - start : (int64_t)start - clip0;
+	};
+	auto minorAt = [&](int64_t k) {
+		return std::max<int64_t>(0, floor_div64(2 * k * minor - major + 2 * major - 1, 2 * major));
+	};
+	int64_t majorFirst, majorLast, minorFirst, minorLast;
+	clipOffsets(majorStart, majorStep, majorClip0, majorClip1, majorFirst, majorLast);
+	clipOffsets(minorStart, minorStep, minorClip0, minorClip1, minorFirst, minorLast);
+	majorFirst = std::max<int64_t>(majorFirst, 0);
+	majorLast = std::min(majorLast, major);
+	if (majorFirst > majorLast) {
+		return;
+	}
+	minorFirst = std::max(minorFirst, minorAt(majorFirst));
+	minorLast = std::min(minorLast, minorAt(majorLast));
+	for (int64_t m = minorFirst; m <= minorLast; ++m) {
+		// Major steps k with minorAt(k) == m
+		const int64_t runFirst = m == 0 ? 0 : floor_div64((2 * m - 1) * major, 2 * minor) + 1;
+		const int64_t runLast = floor_div64((2 * m + 1) * major, 2 * minor);
+		const int a = majorStart + majorStep * (int)std::max(runFirst, majorFirst);
+		const int b = majorStart + majorStep * (int)std::min(runLast, majorLast);
+		const int c = minorStart + minorStep * (int)m;
+		if (xMajor) {
+			fillSpan(a, b, c, color);
+		} else {
+			fillColumn(c, a, b, color);
+		}
+	}
+}
+
 void posiAPIDrawRect(int x1, int y1, int x2, int y2, uint32_t color) {
+    if (drawListRecording()) {
+        drawListRecord(DRAW_RECT, color, {x1, y1, x2, y2});
+        return;
+    }
     int minX = std::min(x1, x2);
     int minY = std::min(y1, y2);
     int maxX = std::max(x1, x2);
@@ -333,85 +1822,226 @@ void posiAPIDrawRect(int x1, int y1, int x2, int y2, uint32_t color) {
 }
 
 void posiAPIDrawFilledRect(int x1, int y1, int x2, int y2, uint32_t color) {
-    int minX = std::min(x1, x2);
-    int minY = std::min(y1, y2);
-    int maxX = std::max(x1, x2);
-    int maxY = std::max(y1, y2);
+    if (drawListRecording()) {
+        drawListRecord(DRAW_FILLED_RECT, color, {x1, y1, x2, y2});
+        return;
+    }
+    int minX = std::min(x1, x2) - cameraX;
+    int minY = std::min(y1, y2) - cameraY;
+    int maxX = std::max(x1, x2) - cameraX;
+    int maxY = std::max(y1, y2) - cameraY;
 
-    // Clamp the rectangle coordinates
-    //minX = std::clamp(minX, 0, screenWidth - 1);
-    //minY = std::clamp(minY, 0, screenHeight - 1);
-    //maxX = std::clamp(maxX, 0, screenWidth - 1);
-    //maxY = std::clamp(maxY, 0, screenHeight - 1);
+    // Only the rows inside the clip rectangle are visited; fillSpan clips each row horizontally
+    minY = std::max(minY, clipRect.y0);
+    maxY = std::min(maxY, clipRect.y1 - 1);
 
-    // Iterate through each row within the rectangle and draw a horizontal line
     for (int y = minY; y <= maxY; ++y) {
-        posiAPIDrawLine(minX, y, maxX, y, color);
+        fillSpan(minX, maxX, y, color);
     }
 }
 
 
+// Ellipses are rasterized a row at a time. A pixel at offset (dx, dy) from the center is inside when
+// (2dx / A)^2 + (2dy / B)^2 <= 1, A and B being the diameters 2rx+1 and 2ry+1, so a circle covers the
+// pixels with dx^2 + dy^2 <= r^2 + r. Radii are limited so those products fit in 64 bits.
+static constexpr int maxEllipseRadius = 32767;
+
+struct EllipseShape {
+	uint64_t a2, b2;
+	int ry;
+
+	EllipseShape(int rx, int ry) : a2((uint64_t)(2 * rx + 1) * (2 * rx + 1)), b2((uint64_t)(2 * ry + 1) * (2 * ry + 1)), ry(ry) {}
+
+	// The largest dx inside the ellipse on row dy, or -1 when the row misses it
+	int halfWidth(int dy) const {
+		if (dy < -ry || dy > ry) {
+			return -1;
+		}
+		const uint64_t limit = a2 * (b2 - 4 * (uint64_t)dy * dy);
+		int dx = (int)std::sqrt((double)limit / (4.0 * (double)b2));
+		while (dx > 0 && 4 * (uint64_t)dx * dx * b2 > limit) {
+			--dx;
+		}
+		while (4 * (uint64_t)(dx + 1) * (dx + 1) * b2 <= limit) {
+			++dx;
+		}
+		return dx;
+	}
+};
+
+// The angular part of an arc. Angles run from +x towards +y. A range wider than half a turn is
+// stored as the narrower range it leaves out, so either way each row is cut by two half-planes.
+struct ArcSector {
+	bool full;
+	bool empty;
+	bool inverted;
+	double fromX, fromY, toX, toY;
+
+	ArcSector(int32_t startAngle, int32_t endAngle) {
+		static constexpr double FULL_TURN = 2 * M_PI;
+		const double start = startAngle / 65536.0;
+		double span = (endAngle - (double)startAngle) / 65536.0;
+		full = std::abs(span) >= FULL_TURN;
+		span = std::fmod(std::fmod(span, FULL_TURN) + FULL_TURN, FULL_TURN);
+		empty = !full && span == 0;
+		inverted = span > M_PI;
+		const double from = inverted ? start + span : start;
+		const double to = inverted ? start + FULL_TURN : start + span;
+		fromX = std::cos(from);
+		fromY = std::sin(from);
+		toX = std::cos(to);
+		toY = std::sin(to);
+	}
+};
+
+// Narrows [lo, hi] to the x offsets where c1 * x + c0 >= 0, or > 0 when strict
+static void clipToHalfPlane(double c1, double c0, bool strict, int64_t& lo, int64_t& hi) {
+	static constexpr double LIMIT = 1e12;
+	if (c1 == 0) {
+		if (strict ? c0 <= 0 : c0 < 0) {
+			lo = 1;
+			hi = 0;
+		}
+		return;
+	}
+	const double root = std::clamp(-c0 / c1, -LIMIT, LIMIT);
+	if (c1 > 0) {
+		lo = std::max(lo, strict ? (int64_t)std::floor(root) + 1 : (int64_t)std::ceil(root));
+	} else {
+		hi = std::min(hi, strict ? (int64_t)std::ceil(root) - 1 : (int64_t)std::floor(root));
+	}
+}
+
+// Fills the part of [x0, x1] of row dy that falls inside the sector
+static void fillSectorSpan(const ArcSector& sector, int centerX, int centerY, int dy, int64_t x0, int64_t x1, uint32_t color) {
+	// The sector between directions f and t is where f x p >= 0 and p x t >= 0
+	int64_t lo = x0, hi = x1;
+	const bool strict = sector.inverted;
+	clipToHalfPlane(-sector.fromY, sector.fromX * dy, strict, lo, hi);
+	clipToHalfPlane(sector.toY, -sector.toX * dy, strict, lo, hi);
+	if (!sector.inverted) {
+		if (lo <= hi) {
+			fillSpan((int)(centerX + lo), (int)(centerX + hi), centerY + dy, color);
+		}
+		return;
+	}
+	if (lo > hi) {
+		fillSpan((int)(centerX + x0), (int)(centerX + x1), centerY + dy, color);
+		return;
+	}
+	if (x0 < lo) {
+		fillSpan((int)(centerX + x0), (int)(centerX + std::min(lo - 1, x1)), centerY + dy, color);
+	}
+	if (hi < x1) {
+		fillSpan((int)(centerX + std::max(hi + 1, x0)), (int)(centerX + x1), centerY + dy, color);
+	}
+}
+
+// Draws an ellipse, filled or as a one pixel outline, optionally limited to a sector. Only rows
+// inside the clip rectangle are visited and every pixel is drawn once.
+static void drawEllipse(int centerX, int centerY, int rx, int ry, bool filled, const ArcSector* sector, uint32_t color) {
+	if (rx < 0 || ry < 0 || (sector && sector->empty)) {
+		return;
+	}
+	rx = std::min(rx, maxEllipseRadius);
+	ry = std::min(ry, maxEllipseRadius);
+	if (outsideClip(centerX - rx, centerY - ry, centerX + rx, centerY + ry)) {
+		return;
+	}
+	const EllipseShape shape(rx, ry);
+	const ClipRect& clip = clipRect;
+	const int dy0 = std::max(-ry, clip.y0 - centerY);
+	const int dy1 = std::min(ry, clip.y1 - 1 - centerY);
+	// Horizontal clip in offsets, so that spans reaching far off screen stay small
+	const int64_t clipX0 = (int64_t)clip.x0 - centerX;
+	const int64_t clipX1 = (int64_t)clip.x1 - 1 - centerX;
+	auto span = [&](int dy, int64_t x0, int64_t x1) {
+		x0 = std::max(x0, clipX0);
+		x1 = std::min(x1, clipX1);
+		if (x0 > x1) {
+			return;
+		}
+		if (sector && !sector->full) {
+			fillSectorSpan(*sector, centerX, centerY, dy, x0, x1, color);
+		} else {
+			fillSpan((int)(centerX + x0), (int)(centerX + x1), centerY + dy, color);
+		}
+	};
+	for (int dy = dy0; dy <= dy1; ++dy) {
+		const int outer = shape.halfWidth(dy);
+		if (filled) {
+			span(dy, -outer, outer);
+			continue;
+		}
+		// The outline is what the next row out doesn't cover, and at least the outermost pixel
+		const int inner = std::min(shape.halfWidth(std::abs(dy) + 1) + 1, outer);
+		if (inner <= 0) {
+			span(dy, -outer, outer);
+		} else {
+			span(dy, -outer, -inner);
+			span(dy, inner, outer);
+		}
+	}
+}
+
 void posiAPIDrawCircle(int centerX, int centerY, int radius, uint32_t color) {
-    int x = 0;
-    int y = radius;
-    int d = 3 - 2 * radius;
-
-    while (x <= y) {
-        posiAPIPutPixel(centerX + x, centerY + y, color);
-        posiAPIPutPixel(centerX - x, centerY + y, color);
-        posiAPIPutPixel(centerX + x, centerY - y, color);
-        posiAPIPutPixel(centerX - x, centerY - y, color);
-        posiAPIPutPixel(centerX + y, centerY + x, color);
-        posiAPIPutPixel(centerX - y, centerY + x, color);
-        posiAPIPutPixel(centerX + y, centerY - x, color);
-        posiAPIPutPixel(centerX - y, centerY - x, color);
-
-        if (d < 0) {
-            d = d + 4 * x + 6;
-        } else {
-            d = d + 4 * (x - y) + 10;
-            y--;
-        }
-        x++;
+    if (drawListRecording()) {
+        drawListRecord(DRAW_CIRCLE, color, {centerX, centerY, radius});
+        return;
     }
+    drawEllipse(centerX - cameraX, centerY - cameraY, radius, radius, false, nullptr, color);
 }
 
 void posiAPIDrawFilledCircle(int centerX, int centerY, int radius, uint32_t color) {
-    int x = 0;
-    int y = radius;
-    int d = 3 - 2 * radius;
-
-    auto drawHorizontalLine = [&](int yCoord, int xStart, int xEnd) {
-        int clampedY = std::clamp(yCoord, 0, screenHeight - 1);
-        int clampedXStart = std::clamp(xStart, 0, screenWidth - 1);
-        int clampedXEnd = std::clamp(xEnd, 0, screenWidth - 1);
-        if (clampedXStart <= clampedXEnd) {
-            posiAPIDrawLine(clampedXStart, clampedY, clampedXEnd, clampedY, color);
-        } else {
-            posiAPIDrawLine(clampedXEnd, clampedY, clampedXStart, clampedY, color);
-        }
-    };
+    if (drawListRecording()) {
+        drawListRecord(DRAW_FILLED_CIRCLE, color, {centerX, centerY, radius});
+        return;
+    }
+    drawEllipse(centerX - cameraX, centerY - cameraY, radius, radius, true, nullptr, color);
+}
+
+void posiAPIDrawEllipse(int centerX, int centerY, int radiusX, int radiusY, uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_ELLIPSE, color, {centerX, centerY, radiusX, radiusY});
+		return;
+	}
+	drawEllipse(centerX - cameraX, centerY - cameraY, radiusX, radiusY, false, nullptr, color);
+}
 
-    while (x <= y) {
-        drawHorizontalLine(centerY + y, centerX - x, centerX + x);
-        drawHorizontalLine(centerY - y, centerX - x, centerX + x);
+void posiAPIDrawFilledEllipse(int centerX, int centerY, int radiusX, int radiusY, uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_FILLED_ELLIPSE, color, {centerX, centerY, radiusX, radiusY});
+		return;
+	}
+	drawEllipse(centerX - cameraX, centerY - cameraY, radiusX, radiusY, true, nullptr, color);
+}
 
-        if (x != y) {
-            drawHorizontalLine(centerY + x, centerX - y, centerX + y);
-            drawHorizontalLine(centerY - x, centerX - y, centerX + y);
-        }
+// Draws the part of an ellipse outline from startAngle to endAngle (16.16 radians, 0 pointing along +x
+// and turning towards +y). A range of a full turn or more draws the whole ellipse.
+void posiAPIDrawArc(int centerX, int centerY, int radiusX, int radiusY, int32_t startAngle, int32_t endAngle, uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_ARC, color, {centerX, centerY, radiusX, radiusY, startAngle, endAngle});
+		return;
+	}
+	const ArcSector sector(startAngle, endAngle);
+	drawEllipse(centerX - cameraX, centerY - cameraY, radiusX, radiusY, false, &sector, color);
+}
 
-        if (d < 0) {
-            d = d + 4 * x + 6;
-        } else {
-            d = d + 4 * (x - y) + 10;
-            y--;
-        }
-        x++;
-    }
+// Filled counterpart of posiAPIDrawArc: a pie slice
+void posiAPIDrawFilledArc(int centerX, int centerY, int radiusX, int radiusY, int32_t startAngle, int32_t endAngle, uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecord(DRAW_FILLED_ARC, color, {centerX, centerY, radiusX, radiusY, startAngle, endAngle});
+		return;
+	}
+	const ArcSector sector(startAngle, endAngle);
+	drawEllipse(centerX - cameraX, centerY - cameraY, radiusX, radiusY, true, &sector, color);
 }
 
 void posiAPIDrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, uint32_t color) {
+    if (drawListRecording()) {
+        drawListRecord(DRAW_TRIANGLE, color, {x1, y1, x2, y2, x3, y3});
+        return;
+    }
 
     // Draw the three lines of the triangle
     posiAPIDrawLine(x1, y1, x2, y2, color);
@@ -419,141 +2049,381 @@ void posiAPIDrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, uint32_
     posiAPIDrawLine(x3, y3, x1, y1, color);
 }
 
+// A triangle edge walked from its top vertex down, with x in 16.16 fixed point.
+// x at a given row only depends on the edge itself, so triangles sharing an edge agree on it exactly.
+struct TriangleEdge {
+	int64_t xTop;
+	int64_t yTop;
+	int64_t slope;
+
+	TriangleEdge(int x1, int y1, int x2, int y2)
+		: xTop((int64_t)x1 << 16), yTop(y1), slope(y2 != y1 ? ((int64_t)(x2 - x1) << 16) / ((int64_t)y2 - y1) : 0) {}
+
+	int64_t xAt(int64_t y) const {
+		return xTop + slope * (y - yTop);
+	}
+};
+
+static inline int fixedCeil(int64_t x) {
+	// Clamped just outside the screen so it always fits in an int
+	return (int)std::clamp<int64_t>((x + 0xFFFF) >> 16, -1, screenWidth);
+}
+
+// Fills rows [yStart, yEnd) between two edges. Vertices sit on pixel centers and the top-left rule applies:
+// a pixel is drawn when its center is inside, or on a left or top edge.
+static void fillTriangleRows(const TriangleEdge& left, const TriangleEdge& right, int64_t yStart, int64_t yEnd, uint32_t color) {
+	yStart = std::max<int64_t>(yStart, clipRect.y0);
+	yEnd = std::min<int64_t>(yEnd, clipRect.y1);
+	if (yStart >= yEnd) {
+		return;
+	}
+	int64_t xl = left.xAt(yStart);
+	int64_t xr = right.xAt(yStart);
+	for (int64_t y = yStart; y < yEnd; ++y) {
+		const int spanStart = fixedCeil(xl);
+		const int spanEnd = fixedCeil(xr) - 1;
+		if (spanStart <= spanEnd) {
+			fillSpan(spanStart, spanEnd, (int)y, color);
+		}
+		xl += left.slope;
+		xr += right.slope;
+	}
+}
+
 void posiAPIDrawFilledTriangle(int x1, int y1, int x2, int y2, int x3, int y3, uint32_t color) {
+    if (drawListRecording()) {
+        drawListRecord(DRAW_FILLED_TRIANGLE, color, {x1, y1, x2, y2, x3, y3});
+        return;
+    }
+    x1 -= cameraX;
+    x2 -= cameraX;
+    x3 -= cameraX;
+    y1 -= cameraY;
+    y2 -= cameraY;
+    y3 -= cameraY;
+    if ((color & COLOR_ALPHA_MASK) == 0) {
+        return;
+    }
+
     // Sort vertices by y-coordinate
-    std::vector<std::pair<int, int>> vertices = {{y1, x1}, {y2, x2}, {y3, x3}};
-    std::sort(vertices.begin(), vertices.end());
-
-    int y_min = vertices[0].first;
-    int y_mid = vertices[1].first;
-    int y_max = vertices[2].first;
-    int x_min = vertices[0].second;
-    int x_mid = vertices[1].second;
-    int x_max = vertices[2].second;
-
-    auto interpolate = [](int y, int y1, int x1, int y2, int x2) {
-        if (y2 == y1) return x1;
-        return static_cast<int>(static_cast<double>(x1) + (static_cast<double>(y - y1) / (y2 - y1)) * (x2 - x1));
-    };
+    if (y2 < y1) { std::swap(x1, x2); std::swap(y1, y2); }
+    if (y3 < y1) { std::swap(x1, x3); std::swap(y1, y3); }
+    if (y3 < y2) { std::swap(x2, x3); std::swap(y2, y3); }
 
-    for (int y = y_min; y <= y_max; ++y) {
-        int x_left, x_right;
+    const ClipRect& clip = clipRect;
+    if (y3 <= clip.y0 || y1 >= clip.y1 || y1 == y3) {
+        return;
+    }
+    if (std::max({x1, x2, x3}) < clip.x0 || std::min({x1, x2, x3}) >= clip.x1) {
+        return;
+    }
 
-        if (y <= y_mid) {
-            x_left = interpolate(y, y_min, x_min, y_mid, x_mid);
-            x_right = interpolate(y, y_min, x_min, y_max, x_max);
-        } else {
-            x_left = interpolate(y, y_mid, x_mid, y_max, x_max);
-            x_right = interpolate(y, y_min, x_min, y_max, x_max);
-        }
+    const TriangleEdge longEdge(x1, y1, x3, y3);
+    const TriangleEdge upperEdge(x1, y1, x2, y2);
+    const TriangleEdge lowerEdge(x2, y2, x3, y3);
+
+    // The middle vertex is on the left when it lies left of the long edge at its own row
+    const bool middleOnLeft = ((int64_t)x2 << 16) < longEdge.xAt(y2);
+    if (middleOnLeft) {
+        fillTriangleRows(upperEdge, longEdge, y1, y2, color);
+        fillTriangleRows(lowerEdge, longEdge, y2, y3, color);
+    } else {
+        fillTriangleRows(longEdge, upperEdge, y1, y2, color);
+        fillTriangleRows(longEdge, lowerEdge, y2, y3, color);
+    }
+}
 
-        if (x_left > x_right) std::swap(x_left, x_right);
+// An edge of a filled polygon, stored top to bottom like a triangle edge. It covers rows
+// [edge.yTop, yBottom); winding is +1 if the polygon runs down along it and -1 if up.
+struct PolygonEdge {
+	TriangleEdge edge;
+	int yBottom;
+	int winding;
+};
+
+// Fills a polygon given as count (x, y) vertex pairs, which may be concave or self-intersecting.
+// rule picks which areas are inside: an odd number of edges to the left, or a non-zero winding.
+// Pixels follow the triangle rules, so a convex polygon covers exactly the pixels of its triangle fan.
+void posiAPIDrawFilledPolygon(const int32_t* points, int count, int rule, uint32_t color) {
+	if (drawListRecording()) {
+		drawListRecordText(DRAW_FILLED_POLYGON, std::string_view((const char*)points, (size_t)count * 2 * sizeof(int32_t)), color, {count, rule});
+		return;
+	}
+	if (count < 3 || (color & COLOR_ALPHA_MASK) == 0) {
+		return;
+	}
+	// Scratch space is per thread because banded replay draws polygons on several threads at once
+	thread_local std::vector<PolygonEdge> edges;
+	thread_local std::vector<const PolygonEdge*> active;
+	thread_local std::vector<std::pair<int64_t, int>> crossings;
+	edges.clear();
+	int minX = std::numeric_limits<int>::max(), minY = minX;
+	int maxX = std::numeric_limits<int>::min(), maxY = maxX;
+	for (int i = 0; i < count; ++i) {
+		const int x0 = points[i * 2] - cameraX;
+		const int y0 = points[i * 2 + 1] - cameraY;
+		const int next = (i + 1) % count;
+		const int x1 = points[next * 2] - cameraX;
+		const int y1 = points[next * 2 + 1] - cameraY;
+		minX = std::min(minX, x0);
+		minY = std::min(minY, y0);
+		maxX = std::max(maxX, x0);
+		maxY = std::max(maxY, y0);
+		if (y0 < y1) {
+			edges.push_back({TriangleEdge(x0, y0, x1, y1), y1, 1});
+		} else if (y1 < y0) {
+			edges.push_back({TriangleEdge(x1, y1, x0, y0), y0, -1});
+		}
+	}
+	if (edges.empty() || outsideClip(minX, minY, maxX, maxY)) {
+		return;
+	}
+	std::sort(edges.begin(), edges.end(), [](const PolygonEdge& a, const PolygonEdge& b) {
+		return a.edge.yTop < b.edge.yTop;
+	});
+
+	const int yStart = std::max(minY, clipRect.y0);
+	const int yEnd = std::min(maxY, clipRect.y1);
+	active.clear();
+	size_t nextEdge = 0;
+	for (int y = yStart; y < yEnd; ++y) {
+		while (nextEdge < edges.size() && edges[nextEdge].edge.yTop <= y) {
+			if (edges[nextEdge].yBottom > y) {
+				active.push_back(&edges[nextEdge]);
+			}
+			++nextEdge;
+		}
+		std::erase_if(active, [y](const PolygonEdge* e) { return e->yBottom <= y; });
+		crossings.clear();
+		for (const PolygonEdge* e : active) {
+			crossings.emplace_back(e->edge.xAt(y), e->winding);
+		}
+		std::sort(crossings.begin(), crossings.end());
+		// Each span runs from a crossing where the area starts to the one where it ends
+		int winding = 0;
+		int64_t spanStart = 0;
+		for (size_t i = 0; i < crossings.size(); ++i) {
+			const int before = winding;
+			winding = rule == POLYGON_NON_ZERO ? winding + crossings[i].second : winding ^ 1;
+			if (before == 0 && winding != 0) {
+				spanStart = crossings[i].first;
+			} else if (before != 0 && winding == 0) {
+				const int x0 = fixedCeil(spanStart);
+				const int x1 = fixedCeil(crossings[i].first) - 1;
+				if (x0 <= x1) {
+					fillSpan(x0, x1, y, color);
+				}
+			}
+		}
+	}
+}
 
-        for (int x = x_left; x <= x_right; ++x) {
-            if (x >= 0 && x < screenWidth && y >= 0 && y < screenHeight) {
-                posiAPIPutPixel(x, y, color);
-            }
-        }
-    }
+static constexpr int TEXT_ASCII_OFFSET = 32;
+static constexpr int TEXT_TAB_WIDTH_IN_CHARS = 4;
+static constexpr int TEXT_PROPORTIONAL_SPACE_WIDTH = 4;
+
+struct TextExtent {
+	int advance;
+	int width;
+	int height;
+};
+
+static inline int glyphAdvance(const GlyphMetrics& glyph, bool proportional) {
+	if (!proportional) {
+		return tileSide;
+	}
+	const int charPixelWidth = glyph.horzMax >= 0 ? glyph.horzMax - glyph.horzMin + 1 : TEXT_PROPORTIONAL_SPACE_WIDTH;
+	return charPixelWidth + 1; // +1 for spacing
 }
 
-int posiAPIDrawText(const std::string& text, int x, int y, bool proportional, uint32_t color, int fontTileStart) {
-    constexpr uint32_t TRANSPARENT_COLOR = 0x00000000;
-    constexpr int ASCII_OFFSET = 32;
-    constexpr int TAB_WIDTH_IN_CHARS = 4;
-    constexpr int PROPORTIONAL_SPACE_WIDTH = 4; 
+static inline const GlyphMetrics* glyphFor(char ch, int fontTileStart) {
+	if (ch < ' ') {
+		return nullptr;
+	}
+	const int tileId = fontTileStart + ch - TEXT_ASCII_OFFSET;
+	if (tileId >= numTiles) {
+		return nullptr;
+	}
+	return &tilePages[tileId / tilesPerPage].glyphs[tileId % tilesPerPage];
+}
 
-    if (x < 0 || y < 0 || fontTileStart < 0 || fontTileStart >= numTiles) {
-        return 0;
-    }
+// Walks text the way it is laid out on screen and calls emit(tileId, glyph, penX, penY) for every glyph.
+// Layout stops once the pen reaches stopX or stopY. With a positive wrapWidth, a word that would
+// cross it starts a new line; words wider than wrapWidth are not split.
+template<typename EmitGlyph>
+static TextExtent layoutText(std::string_view text, int x, int y, bool proportional, int fontTileStart, int wrapWidth, int stopX, int stopY, EmitGlyph&& emit) {
+	int cursorX = x;
+	int cursorY = y;
+	int totalWidth = 0;
+	int maxLineWidth = 0;
+	int lineWidth = 0; // up to the last glyph that isn't a space
+	int currentLineHeight = 0;
+	bool atWordStart = true;
+
+	auto newLine = [&]() {
+		maxLineWidth = std::max(maxLineWidth, lineWidth);
+		lineWidth = 0;
+		cursorX = x;
+		cursorY += proportional ? (currentLineHeight + 1) : tileSide;
+		currentLineHeight = 0;
+	};
+
+	for (size_t i = 0; i < text.size(); ++i) {
+		const char ch = text[i];
+		if (cursorX >= stopX || cursorY >= stopY) {
+			break;
+		}
 
-    int cursorX = x;
-    int cursorY = y;
-    int totalWidth = 0;
-    int currentLineHeight = 0;
+		if (ch == '\n') {
+			newLine();
+			atWordStart = true;
+			continue;
+		}
 
-    for (const char ch : text) {
-        if (cursorX >= screenWidth || cursorY >= screenHeight) {
-            break; 
-        }
+		if (ch == '\t') {
+			const int tabStopWidthPixels = TEXT_TAB_WIDTH_IN_CHARS * tileSide;
+			int advanceAmount = tabStopWidthPixels - ((cursorX - x) % tabStopWidthPixels);
+			cursorX += advanceAmount;
+			totalWidth += advanceAmount;
+			atWordStart = true;
+			continue;
+		}
 
-        if (ch == '\n') {
-            cursorX = x;
-            int yAdvance = proportional ? (currentLineHeight + 1) : tileSide;
-            cursorY += yAdvance;
-            currentLineHeight = 0;
-            continue;
-        }
+		const GlyphMetrics* glyph = glyphFor(ch, fontTileStart);
+		if (!glyph) {
+			continue;
+		}
 
-        if (ch == '\t') {
-            const int tabStopWidthPixels = TAB_WIDTH_IN_CHARS * tileSide;
-            int advanceAmount = tabStopWidthPixels - ((cursorX - x) % tabStopWidthPixels);
-            cursorX += advanceAmount;
-            totalWidth += advanceAmount;
-            continue;
-        }
+		if (ch == ' ') {
+			atWordStart = true;
+		} else if (atWordStart) {
+			atWordStart = false;
+			if (wrapWidth > 0 && cursorX > x) {
+				int wordAdvance = 0;
+				for (size_t j = i; j < text.size() && text[j] != ' ' && text[j] != '\n' && text[j] != '\t'; ++j) {
+					if (const GlyphMetrics* g = glyphFor(text[j], fontTileStart)) {
+						wordAdvance += glyphAdvance(*g, proportional);
+					}
+				}
+				if (cursorX - x + wordAdvance > wrapWidth) {
+					newLine();
+					if (cursorY >= stopY) {
+						break;
+					}
+				}
+			}
+		}
 
-        if (ch < ' ' || ch > 127) {
-            continue;
-        }
+		if (proportional && glyph->vertMax > currentLineHeight) {
+			currentLineHeight = glyph->vertMax;
+		}
 
-        const int tileId = fontTileStart + ch - ASCII_OFFSET;
-        if (tileId >= numTiles) {
-            continue;
-        }
+		emit(fontTileStart + ch - TEXT_ASCII_OFFSET, *glyph, cursorX, cursorY);
 
-        const int tileDataOffset = tileId * tileSide * tileSide;
-
-        int charPixelWidth = tileSide;
-        int charPixelHeight = tileSide;
-        int horzMin = tileSide;
-        int horzMax = -1;     
-        int vertMax = -1;
-
-        if (proportional) {
-            for (int tileY = 0; tileY < tileSide; ++tileY) {
-                for (int tileX = 0; tileX < tileSide; ++tileX) {
-                    if (tiles[tileDataOffset + tileY * tileSide + tileX] != TRANSPARENT_COLOR) {
-                        if (tileX < horzMin) horzMin = tileX;
-                        if (tileX > horzMax) horzMax = tileX;
-                        if (tileY > vertMax) vertMax = tileY;
-                    }
-                }
-            }
+		const int charAdvance = glyphAdvance(*glyph, proportional);
+		cursorX += charAdvance;
+		totalWidth += charAdvance;
+		if (ch != ' ') {
+			lineWidth = cursorX - x;
+		}
+	}
+
+	maxLineWidth = std::max(maxLineWidth, lineWidth);
+	const int lastLineHeight = proportional ? (currentLineHeight + 1) : tileSide;
+	return {totalWidth, maxLineWidth, text.empty() ? 0 : cursorY - y + lastLineHeight};
+}
+
+// Plots the non-zero pixels of a glyph in the given color, clipped to the clip rectangle.
+static void drawGlyph(int tileId, const GlyphMetrics& glyph, bool proportional, int penX, int penY, uint32_t color) {
+	if (glyph.horzMax < 0) {
+		return;
+	}
+	const int horzMin = proportional ? glyph.horzMin : 0;
+	const int horzMax = proportional ? glyph.horzMax : tileSide - 1;
+	const int vertMax = proportional ? glyph.vertMax : tileSide - 1;
+	const ClipRect& clip = clipRect;
+	const int dirtyX0 = std::max(penX, clip.x0);
+	const int dirtyX1 = std::min(penX + horzMax - horzMin + 1, clip.x1);
+	if (dirtyX0 >= dirtyX1) {
+		return;
+	}
+
+	for (int tileY = 0; tileY <= vertMax; ++tileY) {
+		const int pixelDestY = penY + tileY;
+		if (pixelDestY < clip.y0 || pixelDestY >= clip.y1) {
+			continue;
+		}
+		uint32_t scratch[tileSide];
+		const uint32_t* rowPixels = tileRowPixels(tileId, tileY, scratch);
+		uint32_t* dstRow = targetRow(pixelDestY);
+		markDirty(dirtyX0, dirtyX1, pixelDestY, pixelDestY + 1);
+		for (int tileX = horzMin; tileX <= horzMax; ++tileX) {
+			// The pixel's position on screen is offset by its position within the tile's bounding box
+			const int pixelDestX = penX + (tileX - horzMin);
+			if (rowPixels[tileX] != 0 && pixelDestX >= clip.x0 && pixelDestX < clip.x1) {
+				plotPixel(&dstRow[pixelDestX], color);
+			}
+		}
+	}
+}
+
+int posiAPIDrawText(std::string_view text, int x, int y, bool proportional, uint32_t color, int fontTileStart) {
+    const int screenX = x - cameraX;
+    const int screenY = y - cameraY;
+    if (screenX < 0 || screenY < 0 || fontTileStart < 0 || fontTileStart >= numTiles) {
+        return 0;
+    }
+
+    const bool recording = drawListRecording();
+    if (recording) {
+        drawListRecordText(DRAW_TEXT, text, color, {x, y, proportional, fontTileStart});
+    }
 
-            if (horzMax != -1) { 
-                charPixelWidth = horzMax - horzMin + 1;
-                charPixelHeight = vertMax + 1;
-            } else {
-                charPixelWidth = PROPORTIONAL_SPACE_WIDTH;
-                horzMin = 0; 
+    const bool visible = !recording && (color & COLOR_ALPHA_MASK) != 0;
+    auto extent = layoutText(text, screenX, screenY, proportional, fontTileStart, 0, screenWidth, screenHeight,
+        [&](int tileId, const GlyphMetrics& glyph, int penX, int penY) {
+            if (visible) {
+                drawGlyph(tileId, glyph, proportional, penX, penY, color);
             }
-        } else {
-             horzMin = 0;
-             horzMax = tileSide - 1;
-             vertMax = tileSide - 1;
-        }
+        });
+    return extent.advance;
+}
 
-        if (proportional && vertMax > currentLineHeight) {
-            currentLineHeight = vertMax;
-        }
+std::pair<int, int> posiAPIDrawTextWrapped(std::string_view text, int x, int y, int wrapWidth, bool proportional, uint32_t color, int fontTileStart) {
+    if (fontTileStart < 0 || fontTileStart >= numTiles) {
+        return {0, 0};
+    }
 
-        for (int tileY = 0; tileY <= vertMax; ++tileY) {
-            for (int tileX = horzMin; tileX <= horzMax; ++tileX) {
-                uint32_t pixelColor = tiles[tileDataOffset + tileY * tileSide + tileX];
-                if (pixelColor != TRANSPARENT_COLOR) {
-                    // The pixel's position on screen is offset by its position within the tile's bounding box
-                    int pixelDestX = cursorX + (tileX - horzMin);
-                    int pixelDestY = cursorY + tileY;
-                    posiAPIPutPixel(pixelDestX, pixelDestY, color);
-                }
+    const bool recording = drawListRecording();
+    if (recording) {
+        drawListRecordText(DRAW_TEXT_WRAPPED, text, color, {x, y, wrapWidth, proportional, fontTileStart});
+    }
+    x -= cameraX;
+    y -= cameraY;
+
+    const bool visible = !recording && (color & COLOR_ALPHA_MASK) != 0;
+    auto extent = layoutText(text, x, y, proportional, fontTileStart, wrapWidth, std::numeric_limits<int>::max(), screenHeight,
+        [&](int tileId, const GlyphMetrics& glyph, int penX, int penY) {
+            if (visible) {
+                drawGlyph(tileId, glyph, proportional, penX, penY, color);
             }
-        }
+        });
+    return {extent.width, extent.height};
+}
 
-        const int charAdvance = proportional ? (charPixelWidth + 1) : tileSide; // +1 for spacing
-        cursorX += charAdvance;
-        totalWidth += charAdvance;
+std::pair<int, int> posiAPIMeasureText(std::string_view text, int wrapWidth, bool proportional, int fontTileStart) {
+    if (fontTileStart < 0 || fontTileStart >= numTiles) {
+        return {0, 0};
     }
 
-    return totalWidth;
+    constexpr int unbounded = std::numeric_limits<int>::max();
+    auto extent = layoutText(text, 0, 0, proportional, fontTileStart, wrapWidth, unbounded, unbounded,
+        [](int, const GlyphMetrics&, int, int) {});
+    return {extent.width, extent.height};
+}
+
+int posiAPIDrawNumber(int64_t value, int x, int y, bool proportional, uint32_t color, int fontTileStart) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return posiAPIDrawText(std::string_view(digits, result.ptr - digits), x, y, proportional, color, fontTileStart);
 }
@@ -97,7 +97,9 @@ void posiChangeState(int newState) {
 }
 
 bool posiStateGameRun() {
-	return luaCallTick();
+	bool result = luaCallTick();
+	gpuEndFrame();
+	return result;
 }
 
 int16_t floatToInt16(float sample) {
@@ -2,6 +2,9 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <initializer_list>
 #include <vector>
 #include <optional>
 
@@ -16,6 +19,7 @@ constexpr auto pixelsPerPage = tilesPerPage * tileSide * tileSide;
 constexpr auto numTilePages = 64;
 constexpr auto numTiles = tilesPerPage * numTilePages;
 constexpr auto numTilesPixels = pixelsPerPage * numTilePages;
+constexpr auto tilePaletteSize = 256;
 
 constexpr auto pixelRowSize = 16 * tileSide;
 constexpr auto tileRowSize = pixelRowSize * tileSide;
@@ -31,6 +35,18 @@ constexpr auto tilemapTotalHeightTiles = tilemapScreenHeightTiles * tilemapHeigh
 constexpr auto tilemapTotalTiles = tilemapTotalWidthTiles * tilemapTotalHeightTiles;
 constexpr auto tilemapTotalBytes = tilemapTotalTiles * 2;
 
+constexpr auto drawCommandMaxArgs = 9;
+constexpr auto maxSurfaces = 16;
+constexpr auto spriteFlipHorz = 1;
+constexpr auto spriteFlipVert = 2;
+constexpr auto spriteTableSize = 1024;
+constexpr auto numScrollTables = 4;
+constexpr auto maxCachedTilemaps = 4;
+constexpr auto tileFlagSolid = 1;
+constexpr auto tileFlagOneWay = 2;
+constexpr auto tileFlagHazard = 4;
+constexpr auto tileFlagLadder = 8;
+
 constexpr auto numInputButtons = 12;
 constexpr auto numAudioChannels = 8;
 
@@ -50,6 +66,31 @@ bool luaReset();
 bool luaEvalMain(std::string code);
 
 enum PosiState {POSI_STATE_EMPTY, POSI_STATE_GAME};
+enum BlendMode {BLEND_OPAQUE, BLEND_ALPHA, BLEND_ADD, BLEND_MULTIPLY, BLEND_SUBTRACT, BLEND_MODE_COUNT};
+enum DrawCommandType {DRAW_CLS, DRAW_PIXEL, DRAW_SPRITE, DRAW_TILEMAP, DRAW_LINE, DRAW_RECT, DRAW_FILLED_RECT,
+	DRAW_CIRCLE, DRAW_FILLED_CIRCLE, DRAW_TRIANGLE, DRAW_FILLED_TRIANGLE, DRAW_TEXT, DRAW_TEXT_WRAPPED, DRAW_SURFACE,
+	DRAW_TILEMAP_SCANLINES, DRAW_SPRITE_AFFINE, DRAW_MODE7, DRAW_PIXELS, DRAW_COPY_RECT, DRAW_SCROLL_RECT,
+	DRAW_ELLIPSE, DRAW_FILLED_ELLIPSE, DRAW_ARC, DRAW_FILLED_ARC, DRAW_FILLED_POLYGON};
+enum Mode7Edge {MODE7_WRAP, MODE7_CLAMP};
+enum PolygonFillRule {POLYGON_EVEN_ODD, POLYGON_NON_ZERO};
+
+// Settings a deferred draw command is replayed with. The clip rectangle is half-open.
+struct DrawState {
+	BlendMode blend = BLEND_OPAQUE;
+	int cameraX = 0, cameraY = 0;
+	int clipX0 = 0, clipY0 = 0, clipX1 = screenWidth, clipY1 = screenHeight;
+};
+
+// A changed area of the framebuffer, in pixels
+struct DirtyRect {
+	int x, y, w, h;
+};
+
+// One sprite of a batch; flags is a combination of spriteFlipHorz and spriteFlipVert
+struct SpriteDesc {
+	int32_t id, w, h, x, y;
+	uint32_t flags;
+};
 
 void posiPoweron();
 void posiPoweroff();
@@ -65,26 +106,84 @@ void gpuInit();
 void gpuLoad();
 void gpuClear();
 void gpuReset();
+void gpuEndFrame();
+DrawState gpuGetDrawState();
+void gpuSetDrawState(const DrawState& state);
+void gpuSetClipRows(int y0, int y1);
+int gpuGetDrawTarget();
 uint32_t* gpuGetBuffer();
+void gpuTakeDirtyRects(std::vector<DirtyRect>& rects);
 void posiRedraw(uint32_t* buffer);
 void posiPutPixel(int x, int y, uint32_t color);
+void posiAPISetBlendMode(int mode);
+void posiAPISetCamera(int x, int y);
+void posiAPISetClipRect(int x, int y, int w, int h);
+void posiAPIResetClipRect();
 void posiAPICls(uint32_t color);
 uint32_t posiAPIGetPixel(int x, int y);
 void posiAPIPutPixel(int x, int y, uint32_t color);
+void posiAPIReadPixels(int x, int y, int w, int h, uint32_t* out);
+void posiAPIWritePixels(int x, int y, int w, int h, const uint32_t* pixels);
+void posiAPICopyRect(int sx, int sy, int w, int h, int dx, int dy);
+void posiAPIScrollRect(int x, int y, int w, int h, int dx, int dy);
 uint32_t gpuGetTilePagePixel(int pageNum, int x, int y);
 uint32_t gpuGetTilePixel(int tileNum, int x, int y);
+uint32_t posiAPIGetTilePaletteColor(int pageNum, int index);
+void posiAPISetTilePaletteColor(int pageNum, int index, uint32_t color);
 void posiAPIDrawSprite(int id, int w, int h, int x, int y, bool flipHorz, bool flipVert);
+void posiAPIDrawSprites(const SpriteDesc* sprites, int count);
+bool posiAPISpritesOverlap(const SpriteDesc& a, const SpriteDesc& b);
+void posiAPIDrawSpriteAffine(int id, int w, int h, int x, int y, int32_t a, int32_t b, int32_t c, int32_t d);
 void posiAPIDrawTilemap(int tilemapNum, int tmx, int tmy, int tmw, int tmh, int x, int y);
+void posiAPISetScrollLine(int table, int line, int dx, int dy);
+void posiAPIDrawTilemapScanlines(int table, int tilemapNum, int tmx, int tmy, int tmw, int tmh, int x, int y);
+void posiAPIDrawMode7(int tilemapNum, int32_t camX, int32_t camY, int32_t angle, int32_t height, int horizon, int focal, int edge);
 void posiAPIDrawLine(int x1, int y1, int x2, int y2, uint32_t color);
 void posiAPIDrawRect(int x1, int y1, int x2, int y2, uint32_t color) ;
 void posiAPIDrawFilledRect(int x1, int y1, int x2, int y2, uint32_t color);
 void posiAPIDrawCircle(int centerX, int centerY, int radius, uint32_t color);
 void posiAPIDrawFilledCircle(int centerX, int centerY, int radius, uint32_t color);
+void posiAPIDrawEllipse(int centerX, int centerY, int radiusX, int radiusY, uint32_t color);
+void posiAPIDrawFilledEllipse(int centerX, int centerY, int radiusX, int radiusY, uint32_t color);
+void posiAPIDrawArc(int centerX, int centerY, int radiusX, int radiusY, int32_t startAngle, int32_t endAngle, uint32_t color);
+void posiAPIDrawFilledArc(int centerX, int centerY, int radiusX, int radiusY, int32_t startAngle, int32_t endAngle, uint32_t color);
 void posiAPIDrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, uint32_t color) ;
 void posiAPIDrawFilledTriangle(int x1, int y1, int x2, int y2, int x3, int y3, uint32_t color);
-int posiAPIDrawText(const std::string& text, int x, int y, bool proportional, uint32_t color,int start);
+void posiAPIDrawFilledPolygon(const int32_t* points, int count, int rule, uint32_t color);
+int posiAPIDrawText(std::string_view text, int x, int y, bool proportional, uint32_t color,int start);
+std::pair<int, int> posiAPIDrawTextWrapped(std::string_view text, int x, int y, int wrapWidth, bool proportional, uint32_t color, int start);
+std::pair<int, int> posiAPIMeasureText(std::string_view text, int wrapWidth, bool proportional, int start);
+int posiAPIDrawNumber(int64_t value, int x, int y, bool proportional, uint32_t color, int start);
 uint16_t posiAPIGetTilemapEntry(int tilemapNum, int tmx, int tmy);
 void posiAPISetTilemapEntry(int tilemapNum, int tmx, int tmy, uint16_t entry);
+bool posiAPISetTilemapCached(int tilemapNum, bool cached);
+uint8_t posiAPIGetTileFlags(int tileNum);
+void posiAPISetTileFlags(int tileNum, uint8_t flags);
+int posiAPITilemapFlagsInRect(int tilemapNum, int x, int y, int w, int h, int mask);
+bool posiAPITilemapRaycast(int tilemapNum, int x0, int y0, int x1, int y1, int mask, int& hitTx, int& hitTy);
+int posiAPITilemapGroundHeight(int tilemapNum, int x, int y, int w, int maxDistance, int mask);
+int posiAPICreateSurface(int w, int h);
+void posiAPIFreeSurface(int id);
+void posiAPIClearSurface(int id, uint32_t color);
+void posiAPISetDrawTarget(int id);
+void posiAPIDrawSurface(int id, int sx, int sy, int sw, int sh, int x, int y);
+
+bool drawListRecording();
+void drawListRecord(DrawCommandType type, uint32_t color, std::initializer_list<int> args);
+void drawListRecordText(DrawCommandType type, std::string_view text, uint32_t color, std::initializer_list<int> args);
+void drawListRecordSprite(const SpriteDesc& sprite, int layer);
+void drawListFlush();
+void drawListClear();
+void posiAPISetDrawDeferred(bool enabled);
+void posiAPISetDrawLayer(int layer);
+void posiAPISetRenderThreads(int count);
+
+void spriteTableSubmit();
+void spriteTableClear();
+void posiAPISetSprite(int index, int id, int w, int h, int x, int y, int flags, int priority);
+void posiAPIMoveSprite(int index, int x, int y);
+void posiAPISetSpriteVisible(int index, bool visible);
+void posiAPIClearSprites();
 
 void apuInit();
 void apuClearBuffer();
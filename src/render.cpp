@@ -1,6 +1,7 @@
 #include "render.h"
 
 #include <iostream>
+#include <algorithm>
 
 #include <SDL3/SDL.h>
 #include "gl.h"
@@ -33,6 +34,11 @@ uint64_t last_time = SDL_GetPerformanceCounter();
 double accumulator = 0.0;
 const double fixed_delta_time = 1.0 / 60.0; // Our target update rate (in seconds)
 
+// Frames to keep presenting after the last window event, so ImGui can settle hover and focus state
+constexpr int uiSettleFrames = 3;
+int uiActiveFrames = uiSettleFrames;
+std::vector<DirtyRect> dirtyRects;
+
 bool isFileLoaded;
 bool isFullscreen;
 bool isPaused;
@@ -188,13 +194,36 @@ bool drawMenuBar() {
 	return result;
 }
 
+// Uploads only the parts of the framebuffer drawn since the last upload.
+// Returns false when nothing changed.
+bool uploadDirtyRects() {
+	gpuTakeDirtyRects(dirtyRects);
+	if (dirtyRects.empty()) {
+		return false;
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, screenWidth);
+	for (const auto& rect : dirtyRects) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_BGRA, GL_UNSIGNED_BYTE,
+			videoBuffer + rect.y * screenWidth + rect.x);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	return true;
+}
+
 bool posiSDLRender() {
 	bool result = false;
 	if (isFullscreen != lastFullscreenState) {
 		SDL_SetWindowFullscreen(window, isFullscreen);
 		lastFullscreenState = isFullscreen;
+		uiActiveFrames = uiSettleFrames;
+	}
+	const bool frameChanged = uploadDirtyRects();
+	if (!frameChanged && uiActiveFrames == 0) {
+		// Nothing on screen can have changed, so skip building and presenting the frame
+		SDL_Delay(1);
+		return result;
 	}
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, screenWidth, screenHeight, GL_BGRA, GL_UNSIGNED_BYTE, videoBuffer);
+	uiActiveFrames = std::max(uiActiveFrames - 1, 0);
 	int w, h;
 	SDL_GetWindowSize(window, &w, &h);
 	ImGui_ImplOpenGL3_NewFrame();
@@ -259,6 +288,7 @@ bool posiSDLHandleEvents() {
 	SDL_Event event;
 	while(SDL_PollEvent(&event)) {
 		ImGui_ImplSDL3_ProcessEvent(&event);
+		uiActiveFrames = uiSettleFrames;
 		if (event.type == SDL_EVENT_QUIT) {
 			result = true;
 		} else if (event.type == SDL_EVENT_KEY_DOWN) {
@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cstring>
+#include <cmath>
 
 extern "C" {
 #include <lua.h>
@@ -198,6 +199,71 @@ static int lua_api_pixel(lua_State *L) {
     }
 }
 
+static int l_posiAPISetCamera(lua_State *L) {
+    if (lua_gettop(L) != 2) {
+        return luaL_error(L, "API_setCamera expects 2 arguments (x, y).");
+    }
+    int x = luaL_checkinteger(L, 1);
+    int y = luaL_checkinteger(L, 2);
+    posiAPISetCamera(x, y);
+    return 0;
+}
+
+// setClipRect(x, y, w, h) restricts drawing to a rectangle; setClipRect() removes the restriction
+static int l_posiAPISetClipRect(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc == 0) {
+        posiAPIResetClipRect();
+        return 0;
+    }
+    if (argc != 4) {
+        return luaL_error(L, "API_setClipRect expects 0 or 4 arguments (x, y, w, h).");
+    }
+    int x = luaL_checkinteger(L, 1);
+    int y = luaL_checkinteger(L, 2);
+    int w = luaL_checkinteger(L, 3);
+    int h = luaL_checkinteger(L, 4);
+    posiAPISetClipRect(x, y, w, h);
+    return 0;
+}
+
+// setBlendMode(mode): 0 opaque, 1 alpha, 2 additive, 3 multiply, 4 subtract
+static int l_posiAPISetBlendMode(lua_State *L) {
+    if (lua_gettop(L) != 1) {
+        return luaL_error(L, "API_setBlendMode expects 1 argument (mode).");
+    }
+    int mode = luaL_checkinteger(L, 1);
+    posiAPISetBlendMode(mode);
+    return 0;
+}
+
+// setDrawDeferred(enabled): queue draws and render them sorted by layer at the end of the tick
+static int l_posiAPISetDrawDeferred(lua_State *L) {
+    if (lua_gettop(L) != 1) {
+        return luaL_error(L, "API_setDrawDeferred expects 1 argument (enabled).");
+    }
+    posiAPISetDrawDeferred(lua_toboolean(L, 1));
+    return 0;
+}
+
+static int l_posiAPISetDrawLayer(lua_State *L) {
+    if (lua_gettop(L) != 1) {
+        return luaL_error(L, "API_setDrawLayer expects 1 argument (layer).");
+    }
+    int layer = luaL_checkinteger(L, 1);
+    posiAPISetDrawLayer(layer);
+    return 0;
+}
+
+static int l_posiAPISetRenderThreads(lua_State *L) {
+    if (lua_gettop(L) != 1) {
+        return luaL_error(L, "API_setRenderThreads expects 1 argument (count).");
+    }
+    int count = luaL_checkinteger(L, 1);
+    posiAPISetRenderThreads(count);
+    return 0;
+}
+
 // Lua C function for the posiAPITilePagePixel pair
 static int l_posiAPIGetTilePagePixel(lua_State *L) {
   int n = lua_gettop(L);
@@ -236,6 +302,34 @@ static int l_posiAPIGetTilePixel(lua_State *L) {
   }
 }
 
+static int l_posiAPIGetTilePaletteColor(lua_State *L) {
+  int n = lua_gettop(L);
+
+  if (n == 2) {
+    int pageNum = luaL_checkinteger(L, 1);
+    int index = luaL_checkinteger(L, 2);
+    uint32_t result = posiAPIGetTilePaletteColor(pageNum, index);
+    lua_pushinteger(L, result);
+    return 1;
+  } else {
+    return luaL_error(L, "Wrong number of arguments for posiAPIGetTilePaletteColor. Expected 2, got %d", n);
+  }
+}
+
+static int l_posiAPISetTilePaletteColor(lua_State *L) {
+  int n = lua_gettop(L);
+
+  if (n == 3) {
+    int pageNum = luaL_checkinteger(L, 1);
+    int index = luaL_checkinteger(L, 2);
+    uint32_t color = (uint32_t)luaL_checkinteger(L, 3);
+    posiAPISetTilePaletteColor(pageNum, index, color);
+    return 0;
+  } else {
+    return luaL_error(L, "Wrong number of arguments for posiAPISetTilePaletteColor. Expected 3, got %d", n);
+  }
+}
+
 static int lua_api_drawSprite(lua_State *L) {
     lua_Integer id, w, h, x, y;
     bool flipHorz, flipVert;
@@ -265,6 +359,192 @@ static int lua_api_drawSprite(lua_State *L) {
     return 0; // No return value to Lua
 }
 
+// Draws many sprites in one call. The batch is either a packed string of records made with
+// string.pack("<i2BBi2i2B", id, w, h, x, y, flags), or a flat table {id, w, h, x, y, flags, id, ...}.
+// flags is 1 for a horizontal flip plus 2 for a vertical one.
+static int lua_api_drawSprites(lua_State *L) {
+    static constexpr size_t RECORD_SIZE = 9;
+    static constexpr int TABLE_STRIDE = 6;
+    static std::vector<SpriteDesc> batch;
+    batch.clear();
+
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        size_t len;
+        const uint8_t* data = (const uint8_t*)lua_tolstring(L, 1, &len);
+        if (len % RECORD_SIZE != 0) {
+            return luaL_argerror(L, 1, "packed sprite data must be a whole number of 9-byte records");
+        }
+        auto i16 = [](const uint8_t* p) { return (int32_t)(int16_t)(p[0] | (p[1] << 8)); };
+        batch.resize(len / RECORD_SIZE);
+        for (auto& sprite : batch) {
+            sprite = {i16(data), data[2], data[3], i16(data + 4), i16(data + 6), data[8]};
+            data += RECORD_SIZE;
+        }
+    } else {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        const lua_Integer len = luaL_len(L, 1);
+        if (len % TABLE_STRIDE != 0) {
+            return luaL_argerror(L, 1, "sprite table length must be a multiple of 6");
+        }
+        batch.resize(len / TABLE_STRIDE);
+        lua_Integer index = 1;
+        for (auto& sprite : batch) {
+            int32_t fields[TABLE_STRIDE];
+            for (auto& field : fields) {
+                lua_rawgeti(L, 1, index++);
+                field = (int32_t)lua_tointeger(L, -1);
+                lua_pop(L, 1);
+            }
+            sprite = {fields[0], fields[1], fields[2], fields[3], fields[4], (uint32_t)fields[5]};
+        }
+    }
+
+    posiAPIDrawSprites(batch.data(), (int)batch.size());
+    return 0;
+}
+
+// setScrollTable(table, dx, dy) takes two arrays of per-line offsets, the first element being
+// screen line 0. Either may be nil, and missing elements are 0.
+static int l_posiAPISetScrollTable(lua_State *L) {
+    int table = luaL_checkinteger(L, 1);
+    const bool hasDx = !lua_isnoneornil(L, 2);
+    const bool hasDy = !lua_isnoneornil(L, 3);
+    if (hasDx) luaL_checktype(L, 2, LUA_TTABLE);
+    if (hasDy) luaL_checktype(L, 3, LUA_TTABLE);
+    for (int line = 0; line < screenHeight; ++line) {
+        int dx = 0;
+        int dy = 0;
+        if (hasDx) {
+            lua_rawgeti(L, 2, line + 1);
+            dx = (int)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+        if (hasDy) {
+            lua_rawgeti(L, 3, line + 1);
+            dy = (int)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+        posiAPISetScrollLine(table, line, dx, dy);
+    }
+    return 0;
+}
+
+static int l_posiAPIDrawTilemapScanlines(lua_State *L) {
+    if (lua_gettop(L) != 8) {
+        return luaL_error(L, "API_drawTilemapScanlines expects 8 arguments (table, tilemapNum, tmx, tmy, tmw, tmh, x, y).");
+    }
+    int table = luaL_checkinteger(L, 1);
+    int tilemapNum = luaL_checkinteger(L, 2);
+    int tmx = luaL_checkinteger(L, 3);
+    int tmy = luaL_checkinteger(L, 4);
+    int tmw = luaL_checkinteger(L, 5);
+    int tmh = luaL_checkinteger(L, 6);
+    int x = luaL_checkinteger(L, 7);
+    int y = luaL_checkinteger(L, 8);
+    posiAPIDrawTilemapScanlines(table, tilemapNum, tmx, tmy, tmw, tmh, x, y);
+    return 0;
+}
+
+// drawMode7(tilemapNum, camX, camY, angle, height, horizon, focal[, clamp]): camX, camY, angle
+// (radians) and height are numbers; the plane wraps around the map unless clamp is true.
+static int l_posiAPIDrawMode7(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 7 && argc != 8) {
+        return luaL_error(L, "API_drawMode7 expects 7 or 8 arguments (tilemapNum, camX, camY, angle, height, horizon, focal[, clamp]).");
+    }
+    auto fixed = [L](int index) { return (int32_t)std::lround(luaL_checknumber(L, index) * 65536.0); };
+    int tilemapNum = luaL_checkinteger(L, 1);
+    int32_t camX = fixed(2);
+    int32_t camY = fixed(3);
+    int32_t angle = fixed(4);
+    int32_t height = fixed(5);
+    int horizon = luaL_checkinteger(L, 6);
+    int focal = luaL_checkinteger(L, 7);
+    int edge = lua_toboolean(L, 8) ? MODE7_CLAMP : MODE7_WRAP;
+    posiAPIDrawMode7(tilemapNum, camX, camY, angle, height, horizon, focal, edge);
+    return 0;
+}
+
+static int l_posiAPISetSprite(lua_State *L) {
+    if (lua_gettop(L) != 8) {
+        return luaL_error(L, "API_setSprite expects 8 arguments (index, id, w, h, x, y, flags, priority).");
+    }
+    int index = luaL_checkinteger(L, 1);
+    int id = luaL_checkinteger(L, 2);
+    int w = luaL_checkinteger(L, 3);
+    int h = luaL_checkinteger(L, 4);
+    int x = luaL_checkinteger(L, 5);
+    int y = luaL_checkinteger(L, 6);
+    int flags = luaL_checkinteger(L, 7);
+    int priority = luaL_checkinteger(L, 8);
+    posiAPISetSprite(index, id, w, h, x, y, flags, priority);
+    return 0;
+}
+
+static int l_posiAPIMoveSprite(lua_State *L) {
+    if (lua_gettop(L) != 3) {
+        return luaL_error(L, "API_moveSprite expects 3 arguments (index, x, y).");
+    }
+    int index = luaL_checkinteger(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    posiAPIMoveSprite(index, x, y);
+    return 0;
+}
+
+static int l_posiAPISetSpriteVisible(lua_State *L) {
+    if (lua_gettop(L) != 2) {
+        return luaL_error(L, "API_setSpriteVisible expects 2 arguments (index, visible).");
+    }
+    int index = luaL_checkinteger(L, 1);
+    posiAPISetSpriteVisible(index, lua_toboolean(L, 2));
+    return 0;
+}
+
+static int l_posiAPIClearSprites(lua_State *L) {
+    if (lua_gettop(L) != 0) {
+        return luaL_error(L, "API_clearSprites expects no arguments.");
+    }
+    posiAPIClearSprites();
+    return 0;
+}
+
+// drawSpriteAffine(id, w, h, x, y, a, b, c, d): the matrix elements are numbers, so a rotation
+// by r scaled by s is (s*cos r, -s*sin r, s*sin r, s*cos r). (x, y) is where the sprite's center goes.
+static int lua_api_drawSpriteAffine(lua_State *L) {
+    if (lua_gettop(L) != 9) {
+        return luaL_error(L, "API_drawSpriteAffine expects 9 arguments (id, w, h, x, y, a, b, c, d).");
+    }
+    int id = luaL_checkinteger(L, 1);
+    int w = luaL_checkinteger(L, 2);
+    int h = luaL_checkinteger(L, 3);
+    int x = luaL_checkinteger(L, 4);
+    int y = luaL_checkinteger(L, 5);
+    int32_t matrix[4];
+    for (int i = 0; i < 4; ++i) {
+        matrix[i] = (int32_t)std::lround(luaL_checknumber(L, 6 + i) * 65536.0);
+    }
+    posiAPIDrawSpriteAffine(id, w, h, x, y, matrix[0], matrix[1], matrix[2], matrix[3]);
+    return 0;
+}
+
+// spritesOverlap(id, w, h, x, y, flags, id2, w2, h2, x2, y2, flags2) is true when the two sprites,
+// drawn with drawSprite's arguments and flags as in drawSprites, share a non-transparent pixel
+static int lua_api_spritesOverlap(lua_State *L) {
+    if (lua_gettop(L) != 12) {
+        return luaL_error(L, "API_spritesOverlap expects 12 arguments (id, w, h, x, y, flags, id2, w2, h2, x2, y2, flags2).");
+    }
+    SpriteDesc sprites[2];
+    for (int i = 0; i < 2; ++i) {
+        const int base = 1 + i * 6;
+        sprites[i] = {(int32_t)luaL_checkinteger(L, base), (int32_t)luaL_checkinteger(L, base + 1),
+            (int32_t)luaL_checkinteger(L, base + 2), (int32_t)luaL_checkinteger(L, base + 3),
+            (int32_t)luaL_checkinteger(L, base + 4), (uint32_t)luaL_checkinteger(L, base + 5)};
+    }
+    lua_pushboolean(L, posiAPISpritesOverlap(sprites[0], sprites[1]));
+    return 1;
+}
+
 static int l_posiAPIDrawTilemap(lua_State *L) {
     // 1. Get arguments from Lua stack and check their types.
     int tilemapNum = luaL_checkinteger(L, 1); // Get the 1st argument, ensure it's an integer
@@ -360,6 +640,82 @@ static int l_posiAPIDrawFilledCircle(lua_State *L) {
     return 0;
 }
 
+static int l_posiAPIDrawEllipse(lua_State *L) {
+    if (lua_gettop(L) != 5) {
+        return luaL_error(L, "API_drawEllipse expects 5 arguments (centerX, centerY, radiusX, radiusY, color).");
+    }
+    int centerX = luaL_checkinteger(L, 1);
+    int centerY = luaL_checkinteger(L, 2);
+    int radiusX = luaL_checkinteger(L, 3);
+    int radiusY = luaL_checkinteger(L, 4);
+    uint32_t color = (uint32_t)luaL_checkinteger(L, 5);
+    posiAPIDrawEllipse(centerX, centerY, radiusX, radiusY, color);
+    return 0;
+}
+
+static int l_posiAPIDrawFilledEllipse(lua_State *L) {
+    if (lua_gettop(L) != 5) {
+        return luaL_error(L, "API_drawFilledEllipse expects 5 arguments (centerX, centerY, radiusX, radiusY, color).");
+    }
+    int centerX = luaL_checkinteger(L, 1);
+    int centerY = luaL_checkinteger(L, 2);
+    int radiusX = luaL_checkinteger(L, 3);
+    int radiusY = luaL_checkinteger(L, 4);
+    uint32_t color = (uint32_t)luaL_checkinteger(L, 5);
+    posiAPIDrawFilledEllipse(centerX, centerY, radiusX, radiusY, color);
+    return 0;
+}
+
+// drawArc(centerX, centerY, radiusX, radiusY, startAngle, endAngle, color) and drawFilledArc (a pie
+// slice) take angles in radians; 0 points right and angles grow clockwise on screen
+static int drawArcArgs(lua_State *L, const char* name, void (*draw)(int, int, int, int, int32_t, int32_t, uint32_t)) {
+    if (lua_gettop(L) != 7) {
+        return luaL_error(L, "API_%s expects 7 arguments (centerX, centerY, radiusX, radiusY, startAngle, endAngle, color).", name);
+    }
+    int centerX = luaL_checkinteger(L, 1);
+    int centerY = luaL_checkinteger(L, 2);
+    int radiusX = luaL_checkinteger(L, 3);
+    int radiusY = luaL_checkinteger(L, 4);
+    int32_t startAngle = (int32_t)std::lround(luaL_checknumber(L, 5) * 65536.0);
+    int32_t endAngle = (int32_t)std::lround(luaL_checknumber(L, 6) * 65536.0);
+    uint32_t color = (uint32_t)luaL_checkinteger(L, 7);
+    draw(centerX, centerY, radiusX, radiusY, startAngle, endAngle, color);
+    return 0;
+}
+
+static int l_posiAPIDrawArc(lua_State *L) {
+    return drawArcArgs(L, "drawArc", posiAPIDrawArc);
+}
+
+static int l_posiAPIDrawFilledArc(lua_State *L) {
+    return drawArcArgs(L, "drawFilledArc", posiAPIDrawFilledArc);
+}
+
+// drawFilledPolygon(points, color[, nonZero]) fills the polygon with vertices {x1, y1, x2, y2, ...}.
+// Overlapping parts are holes unless nonZero is true, in which case they are filled too.
+static int l_posiAPIDrawFilledPolygon(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 2 && argc != 3) {
+        return luaL_error(L, "API_drawFilledPolygon expects 2 or 3 arguments (points, color[, nonZero]).");
+    }
+    static std::vector<int32_t> points;
+    luaL_checktype(L, 1, LUA_TTABLE);
+    const lua_Integer len = luaL_len(L, 1);
+    if (len % 2 != 0) {
+        return luaL_argerror(L, 1, "points must hold x, y pairs");
+    }
+    points.resize(len);
+    for (lua_Integer i = 0; i < len; ++i) {
+        lua_rawgeti(L, 1, i + 1);
+        points[i] = (int32_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+    uint32_t color = (uint32_t)luaL_checkinteger(L, 2);
+    int rule = lua_toboolean(L, 3) ? POLYGON_NON_ZERO : POLYGON_EVEN_ODD;
+    posiAPIDrawFilledPolygon(points.data(), (int)(len / 2), rule, color);
+    return 0;
+}
+
 // Wrapper for posiAPIDrawTriangle
 static int l_posiAPIDrawTriangle(lua_State *L) {
     if (lua_gettop(L) != 7) {
@@ -405,7 +761,7 @@ static int lua_posiAPIDrawText(lua_State *L) {
     // Argument 1: text (string)
     size_t text_len;
     const char* text_c_str = luaL_checklstring(L, 1, &text_len);
-    std::string text(text_c_str, text_len);
+    std::string_view text(text_c_str, text_len);
 
     // Argument 2: x (integer)
     int x = luaL_checkinteger(L, 2);
@@ -433,6 +789,65 @@ static int lua_posiAPIDrawText(lua_State *L) {
     return 1;
 }
 
+static int lua_posiAPIDrawTextWrapped(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 7) {
+        return luaL_error(L, "Expected 7 arguments: text, x, y, width, proportional, color, start. Got %d", argc);
+    }
+
+    size_t text_len;
+    const char* text_c_str = luaL_checklstring(L, 1, &text_len);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    int width = luaL_checkinteger(L, 4);
+    bool proportional = lua_toboolean(L, 5);
+    uint32_t color = static_cast<uint32_t>(luaL_checkinteger(L, 6));
+    int start = luaL_checkinteger(L, 7);
+
+    auto [w, h] = posiAPIDrawTextWrapped(std::string_view(text_c_str, text_len), x, y, width, proportional, color, start);
+
+    lua_pushinteger(L, w);
+    lua_pushinteger(L, h);
+    return 2;
+}
+
+// measureText(text, proportional, start[, width]) returns the width and height the text would take
+static int lua_posiAPIMeasureText(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 3 && argc != 4) {
+        return luaL_error(L, "Expected 3 or 4 arguments: text, proportional, start[, width]. Got %d", argc);
+    }
+
+    size_t text_len;
+    const char* text_c_str = luaL_checklstring(L, 1, &text_len);
+    bool proportional = lua_toboolean(L, 2);
+    int start = luaL_checkinteger(L, 3);
+    int width = (int)luaL_optinteger(L, 4, 0);
+
+    auto [w, h] = posiAPIMeasureText(std::string_view(text_c_str, text_len), width, proportional, start);
+
+    lua_pushinteger(L, w);
+    lua_pushinteger(L, h);
+    return 2;
+}
+
+static int lua_posiAPIDrawNumber(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 6) {
+        return luaL_error(L, "Expected 6 arguments: value, x, y, proportional, color, start. Got %d", argc);
+    }
+
+    lua_Integer value = luaL_checkinteger(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    bool proportional = lua_toboolean(L, 4);
+    uint32_t color = static_cast<uint32_t>(luaL_checkinteger(L, 5));
+    int start = luaL_checkinteger(L, 6);
+
+    lua_pushinteger(L, posiAPIDrawNumber(value, x, y, proportional, color, start));
+    return 1;
+}
+
 static int l_posiAPIGetTilemapEntry(lua_State *L) {
   int num_args = lua_gettop(L);
 
@@ -471,6 +886,220 @@ static int l_posiAPISetTilemapEntry(lua_State *L) {
   }
 }
 
+static int l_posiAPICreateSurface(lua_State *L) {
+    if (lua_gettop(L) != 2) {
+        return luaL_error(L, "API_createSurface expects 2 arguments (w, h).");
+    }
+    int w = luaL_checkinteger(L, 1);
+    int h = luaL_checkinteger(L, 2);
+    lua_pushinteger(L, posiAPICreateSurface(w, h));
+    return 1;
+}
+
+static int l_posiAPIFreeSurface(lua_State *L) {
+    if (lua_gettop(L) != 1) {
+        return luaL_error(L, "API_freeSurface expects 1 argument (id).");
+    }
+    posiAPIFreeSurface(luaL_checkinteger(L, 1));
+    return 0;
+}
+
+static int l_posiAPIClearSurface(lua_State *L) {
+    if (lua_gettop(L) != 2) {
+        return luaL_error(L, "API_clearSurface expects 2 arguments (id, color).");
+    }
+    int id = luaL_checkinteger(L, 1);
+    uint32_t color = (uint32_t)luaL_checkinteger(L, 2);
+    posiAPIClearSurface(id, color);
+    return 0;
+}
+
+// setDrawTarget() or setDrawTarget(-1) goes back to drawing on the screen
+static int l_posiAPISetDrawTarget(lua_State *L) {
+    int id = (int)luaL_optinteger(L, 1, -1);
+    posiAPISetDrawTarget(id);
+    return 0;
+}
+
+static int l_posiAPIDrawSurface(lua_State *L) {
+    if (lua_gettop(L) != 7) {
+        return luaL_error(L, "API_drawSurface expects 7 arguments (id, sx, sy, sw, sh, x, y).");
+    }
+    int id = luaL_checkinteger(L, 1);
+    int sx = luaL_checkinteger(L, 2);
+    int sy = luaL_checkinteger(L, 3);
+    int sw = luaL_checkinteger(L, 4);
+    int sh = luaL_checkinteger(L, 5);
+    int x = luaL_checkinteger(L, 6);
+    int y = luaL_checkinteger(L, 7);
+    posiAPIDrawSurface(id, sx, sy, sw, sh, x, y);
+    return 0;
+}
+
+static int l_posiAPIGetTileFlags(lua_State *L) {
+    if (lua_gettop(L) != 1) {
+        return luaL_error(L, "API_getTileFlags expects 1 argument (tileNum).");
+    }
+    lua_pushinteger(L, posiAPIGetTileFlags(luaL_checkinteger(L, 1)));
+    return 1;
+}
+
+// Tile flags are game-defined bits; the engine names 1 solid, 2 one-way, 4 hazard and 8 ladder
+static int l_posiAPISetTileFlags(lua_State *L) {
+    if (lua_gettop(L) != 2) {
+        return luaL_error(L, "API_setTileFlags expects 2 arguments (tileNum, flags).");
+    }
+    int tileNum = luaL_checkinteger(L, 1);
+    int flags = luaL_checkinteger(L, 2);
+    posiAPISetTileFlags(tileNum, (uint8_t)flags);
+    return 0;
+}
+
+// The tilemap queries take tilemap pixel coordinates; mask defaults to every flag
+
+// tilemapFlagsInRect(tilemapNum, x, y, w, h[, mask]) returns the flags of the tiles under the rectangle
+static int l_posiAPITilemapFlagsInRect(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 5 && argc != 6) {
+        return luaL_error(L, "API_tilemapFlagsInRect expects 5 or 6 arguments (tilemapNum, x, y, w, h[, mask]).");
+    }
+    int tilemapNum = luaL_checkinteger(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    int w = luaL_checkinteger(L, 4);
+    int h = luaL_checkinteger(L, 5);
+    int mask = (int)luaL_optinteger(L, 6, 0xFF);
+    lua_pushinteger(L, posiAPITilemapFlagsInRect(tilemapNum, x, y, w, h, mask));
+    return 1;
+}
+
+// tilemapRaycast(tilemapNum, x0, y0, x1, y1[, mask]) returns the tile coordinates of the first hit, or nil
+static int l_posiAPITilemapRaycast(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 5 && argc != 6) {
+        return luaL_error(L, "API_tilemapRaycast expects 5 or 6 arguments (tilemapNum, x0, y0, x1, y1[, mask]).");
+    }
+    int tilemapNum = luaL_checkinteger(L, 1);
+    int x0 = luaL_checkinteger(L, 2);
+    int y0 = luaL_checkinteger(L, 3);
+    int x1 = luaL_checkinteger(L, 4);
+    int y1 = luaL_checkinteger(L, 5);
+    int mask = (int)luaL_optinteger(L, 6, 0xFF);
+    int hitTx, hitTy;
+    if (!posiAPITilemapRaycast(tilemapNum, x0, y0, x1, y1, mask, hitTx, hitTy)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, hitTx);
+    lua_pushinteger(L, hitTy);
+    return 2;
+}
+
+// tilemapGroundHeight(tilemapNum, x, y, w, maxDistance[, mask]) returns the top row of the first
+// flagged tile at or below y across [x, x + w), or nil
+static int l_posiAPITilemapGroundHeight(lua_State *L) {
+    int argc = lua_gettop(L);
+    if (argc != 5 && argc != 6) {
+        return luaL_error(L, "API_tilemapGroundHeight expects 5 or 6 arguments (tilemapNum, x, y, w, maxDistance[, mask]).");
+    }
+    int tilemapNum = luaL_checkinteger(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    int w = luaL_checkinteger(L, 4);
+    int maxDistance = luaL_checkinteger(L, 5);
+    int mask = (int)luaL_optinteger(L, 6, 0xFF);
+    int ground = posiAPITilemapGroundHeight(tilemapNum, x, y, w, maxDistance, mask);
+    if (ground < 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, ground);
+    }
+    return 1;
+}
+
+// Pixel regions are exchanged as strings of w * h little-endian 32-bit colors, row by row
+static constexpr lua_Integer maxPixelRegionSide = 4096;
+
+// readPixels(x, y, w, h) returns the region as a string; pixels outside the draw target are black
+static int l_posiAPIReadPixels(lua_State *L) {
+    if (lua_gettop(L) != 4) {
+        return luaL_error(L, "API_readPixels expects 4 arguments (x, y, w, h).");
+    }
+    int x = luaL_checkinteger(L, 1);
+    int y = luaL_checkinteger(L, 2);
+    lua_Integer w = luaL_checkinteger(L, 3);
+    lua_Integer h = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, w >= 0 && w <= maxPixelRegionSide, 3, "width out of range");
+    luaL_argcheck(L, h >= 0 && h <= maxPixelRegionSide, 4, "height out of range");
+    luaL_Buffer buffer;
+    uint32_t* pixels = (uint32_t*)luaL_buffinitsize(L, &buffer, w * h * 4);
+    posiAPIReadPixels(x, y, (int)w, (int)h, pixels);
+    luaL_pushresultsize(&buffer, w * h * 4);
+    return 1;
+}
+
+// writePixels(x, y, w, h, data) copies a string made by readPixels (or string.pack) back, clipped
+static int l_posiAPIWritePixels(lua_State *L) {
+    if (lua_gettop(L) != 5) {
+        return luaL_error(L, "API_writePixels expects 5 arguments (x, y, w, h, data).");
+    }
+    int x = luaL_checkinteger(L, 1);
+    int y = luaL_checkinteger(L, 2);
+    lua_Integer w = luaL_checkinteger(L, 3);
+    lua_Integer h = luaL_checkinteger(L, 4);
+    size_t len;
+    const char* data = luaL_checklstring(L, 5, &len);
+    luaL_argcheck(L, w >= 0 && w <= maxPixelRegionSide, 3, "width out of range");
+    luaL_argcheck(L, h >= 0 && h <= maxPixelRegionSide, 4, "height out of range");
+    luaL_argcheck(L, len == (size_t)(w * h * 4), 5, "data must hold w * h 4-byte pixels");
+    // Lua strings carry no alignment guarantee for uint32_t
+    static std::vector<uint32_t> pixels;
+    pixels.resize(w * h);
+    memcpy(pixels.data(), data, len);
+    posiAPIWritePixels(x, y, (int)w, (int)h, pixels.data());
+    return 0;
+}
+
+static int l_posiAPICopyRect(lua_State *L) {
+    if (lua_gettop(L) != 6) {
+        return luaL_error(L, "API_copyRect expects 6 arguments (sx, sy, w, h, dx, dy).");
+    }
+    int sx = luaL_checkinteger(L, 1);
+    int sy = luaL_checkinteger(L, 2);
+    int w = luaL_checkinteger(L, 3);
+    int h = luaL_checkinteger(L, 4);
+    int dx = luaL_checkinteger(L, 5);
+    int dy = luaL_checkinteger(L, 6);
+    posiAPICopyRect(sx, sy, w, h, dx, dy);
+    return 0;
+}
+
+// scrollRect(x, y, w, h, dx, dy) moves the region's contents, wrapping them around its edges
+static int l_posiAPIScrollRect(lua_State *L) {
+    if (lua_gettop(L) != 6) {
+        return luaL_error(L, "API_scrollRect expects 6 arguments (x, y, w, h, dx, dy).");
+    }
+    int x = luaL_checkinteger(L, 1);
+    int y = luaL_checkinteger(L, 2);
+    int w = luaL_checkinteger(L, 3);
+    int h = luaL_checkinteger(L, 4);
+    int dx = luaL_checkinteger(L, 5);
+    int dy = luaL_checkinteger(L, 6);
+    posiAPIScrollRect(x, y, w, h, dx, dy);
+    return 0;
+}
+
+// Each cached tilemap takes 16MB, so at most 4 (maxCachedTilemaps) can be cached at once.
+// Returns whether the tilemap is cached afterwards; turning on a fifth returns false.
+static int l_posiAPISetTilemapCached(lua_State *L) {
+    if (lua_gettop(L) != 2) {
+        return luaL_error(L, "API_setTilemapCached expects 2 arguments (tilemapNum, cached).");
+    }
+    int tilemapNum = luaL_checkinteger(L, 1);
+    lua_pushboolean(L, posiAPISetTilemapCached(tilemapNum, lua_toboolean(L, 2)));
+    return 1;
+}
+
 static int l_posiAPIGetOperatorParameter(lua_State *L) {
   int num_args = lua_gettop(L);
 
@@ -615,20 +1244,61 @@ static const struct luaL_Reg api_funcs[] = {
     {"isJustPressed", lua_api_isJustPressed},
     {"isJustReleased", lua_api_isJustReleased},
     {"drawPixel", lua_api_pixel},
+    {"setBlendMode", l_posiAPISetBlendMode},
+    {"setCamera", l_posiAPISetCamera},
+    {"setClipRect", l_posiAPISetClipRect},
+    {"setDrawDeferred", l_posiAPISetDrawDeferred},
+    {"setDrawLayer", l_posiAPISetDrawLayer},
+    {"setRenderThreads", l_posiAPISetRenderThreads},
 	{"getTilePagePixel",l_posiAPIGetTilePagePixel},
 	{"getTilePixel",l_posiAPIGetTilePixel},
+	{"getTilePaletteColor",l_posiAPIGetTilePaletteColor},
+	{"setTilePaletteColor",l_posiAPISetTilePaletteColor},
     {"drawSprite", lua_api_drawSprite},
+    {"drawSprites", lua_api_drawSprites},
+    {"drawSpriteAffine", lua_api_drawSpriteAffine},
+    {"spritesOverlap", lua_api_spritesOverlap},
+    {"setSprite", l_posiAPISetSprite},
+    {"moveSprite", l_posiAPIMoveSprite},
+    {"setSpriteVisible", l_posiAPISetSpriteVisible},
+    {"clearSprites", l_posiAPIClearSprites},
     {"drawTilemap", l_posiAPIDrawTilemap},
+    {"setScrollTable", l_posiAPISetScrollTable},
+    {"drawTilemapScanlines", l_posiAPIDrawTilemapScanlines},
+    {"drawMode7", l_posiAPIDrawMode7},
 	{"drawLine", l_posiAPIDrawLine},
 	{"drawRect", l_posiAPIDrawRect},
 	{"drawFilledRect", l_posiAPIDrawFilledRect},
 	{"drawTri", l_posiAPIDrawTriangle},
 	{"drawFilledTri", l_posiAPIDrawFilledTriangle},
+	{"drawFilledPolygon", l_posiAPIDrawFilledPolygon},
 	{"drawCircle", l_posiAPIDrawCircle},
 	{"drawFilledCircle", l_posiAPIDrawFilledCircle},
+	{"drawEllipse", l_posiAPIDrawEllipse},
+	{"drawFilledEllipse", l_posiAPIDrawFilledEllipse},
+	{"drawArc", l_posiAPIDrawArc},
+	{"drawFilledArc", l_posiAPIDrawFilledArc},
 	{"drawText", lua_posiAPIDrawText},
+	{"drawTextWrapped", lua_posiAPIDrawTextWrapped},
+	{"measureText", lua_posiAPIMeasureText},
+	{"drawNumber", lua_posiAPIDrawNumber},
     {"getTilemapEntry", l_posiAPIGetTilemapEntry},
 	{"setTilemapEntry", l_posiAPISetTilemapEntry},
+    {"setTilemapCached", l_posiAPISetTilemapCached},
+    {"getTileFlags", l_posiAPIGetTileFlags},
+    {"setTileFlags", l_posiAPISetTileFlags},
+    {"tilemapFlagsInRect", l_posiAPITilemapFlagsInRect},
+    {"tilemapRaycast", l_posiAPITilemapRaycast},
+    {"tilemapGroundHeight", l_posiAPITilemapGroundHeight},
+    {"createSurface", l_posiAPICreateSurface},
+    {"freeSurface", l_posiAPIFreeSurface},
+    {"clearSurface", l_posiAPIClearSurface},
+    {"setDrawTarget", l_posiAPISetDrawTarget},
+    {"drawSurface", l_posiAPIDrawSurface},
+    {"readPixels", l_posiAPIReadPixels},
+    {"writePixels", l_posiAPIWritePixels},
+    {"copyRect", l_posiAPICopyRect},
+    {"scrollRect", l_posiAPIScrollRect},
     {"getOperatorParameter", l_posiAPIGetOperatorParameter},
 	{"setOperatorParameter", l_posiAPISetOperatorParameter},
     {"getGlobalParameter", l_posiAPIGetGlobalParameter},
@@ -0,0 +1,54 @@
+#include "posi.h"
+
+#include <array>
+
+// Engine-owned sprites in the style of console OAM. Entries persist between ticks and are drawn
+// after every tick, so Lua only has to touch the ones that change. Priority is the draw layer:
+// sprites are queued on the deferred draw list and sort with the tick's own deferred drawing,
+// entries of equal priority drawing in index order.
+struct SpriteTableEntry {
+	SpriteDesc sprite{};
+	int priority = 0;
+	bool visible = false;
+};
+
+std::array<SpriteTableEntry, spriteTableSize> spriteTable;
+
+void spriteTableSubmit() {
+	for (const auto& entry : spriteTable) {
+		if (entry.visible) {
+			drawListRecordSprite(entry.sprite, entry.priority);
+		}
+	}
+}
+
+void spriteTableClear() {
+	spriteTable.fill(SpriteTableEntry{});
+}
+
+// Sets every attribute of an entry and makes it visible
+void posiAPISetSprite(int index, int id, int w, int h, int x, int y, int flags, int priority) {
+	if (index < 0 || index >= spriteTableSize) {
+		return;
+	}
+	spriteTable[index] = {{id, w, h, x, y, (uint32_t)flags}, priority, true};
+}
+
+void posiAPIMoveSprite(int index, int x, int y) {
+	if (index < 0 || index >= spriteTableSize) {
+		return;
+	}
+	spriteTable[index].sprite.x = x;
+	spriteTable[index].sprite.y = y;
+}
+
+void posiAPISetSpriteVisible(int index, bool visible) {
+	if (index < 0 || index >= spriteTableSize) {
+		return;
+	}
+	spriteTable[index].visible = visible;
+}
+
+void posiAPIClearSprites() {
+	spriteTableClear();
+}